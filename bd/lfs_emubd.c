@@ -133,6 +133,15 @@ int lfs_emubd_create(const struct lfs_config *cfg,
     bd->ooo_data = NULL;
     bd->disk = NULL;
 
+    // allocate our queue of in-flight erases
+    bd->pending = malloc(bd->cfg->erase_count * sizeof(lfs_emubd_pending_t));
+    if (!bd->pending) {
+        LFS_EMUBD_TRACE("lfs_emubd_create -> %d", LFS_ERR_NOMEM);
+        return LFS_ERR_NOMEM;
+    }
+    bd->pending_off = 0;
+    bd->pending_count = 0;
+
     if (bd->cfg->disk_path) {
         bd->disk = malloc(sizeof(lfs_emubd_disk_t));
         if (!bd->disk) {
@@ -198,6 +207,7 @@ int lfs_emubd_destroy(const struct lfs_config *cfg) {
 
     // clean up other resources 
     lfs_emubd_decblock(bd->ooo_data);
+    free(bd->pending);
     if (bd->disk) {
         bd->disk->rc -= 1;
         if (bd->disk->rc == 0) {
@@ -247,9 +257,16 @@ static int lfs_emubd_powerloss(const struct lfs_config *cfg) {
         }
     }
 
+    // in-flight erases never happen
+    lfs_size_t pending_count = bd->pending_count;
+    bd->pending_count = 0;
+
     // simulate power loss
     bd->cfg->powerloss_cb(bd->cfg->powerloss_data);
 
+    // if we continue, in-flight erases are still in-flight
+    bd->pending_count = pending_count;
+
     // if we continue, undo out-of-order write emulation
     if (bd->cfg->powerloss_behavior == LFS_EMUBD_POWERLOSS_OOO
             && bd->ooo_block != -1) {
@@ -428,9 +445,26 @@ int lfs_emubd_prog(const struct lfs_config *cfg, lfs_block_t block,
     return 0;
 }
 
-int lfs_emubd_erase(const struct lfs_config *cfg, lfs_block_t block) {
-    LFS_EMUBD_TRACE("lfs_emubd_erase(%p, 0x%"PRIx32" (%"PRIu32"))",
-            (void*)cfg, block, ((lfs_emubd_t*)cfg->context)->cfg->erase_size);
+int lfs_emubd_progv(const struct lfs_config *cfg,
+        const struct lfs_segment *segments, lfs_size_t count) {
+    LFS_EMUBD_TRACE("lfs_emubd_progv(%p, %p, %"PRIu32")",
+            (void*)cfg, (void*)segments, count);
+
+    for (lfs_size_t i = 0; i < count; i++) {
+        int err = lfs_emubd_prog(cfg, segments[i].block,
+                segments[i].off, segments[i].buffer, segments[i].size);
+        if (err) {
+            LFS_EMUBD_TRACE("lfs_emubd_progv -> %d", err);
+            return err;
+        }
+    }
+
+    LFS_EMUBD_TRACE("lfs_emubd_progv -> %d", 0);
+    return 0;
+}
+
+static int lfs_emubd_erase_(const struct lfs_config *cfg,
+        lfs_block_t block, lfs_emubd_sleep_t sleep) {
     lfs_emubd_t *bd = cfg->context;
 
     // check if erase is valid
@@ -446,7 +480,6 @@ int lfs_emubd_erase(const struct lfs_config *cfg, lfs_block_t block) {
     // get the block
     lfs_emubd_block_t *b = lfs_emubd_mutblock(cfg, &bd->blocks[block]);
     if (!b) {
-        LFS_EMUBD_TRACE("lfs_emubd_erase -> %d", LFS_ERR_NOMEM);
         return LFS_ERR_NOMEM;
     }
 
@@ -455,11 +488,9 @@ int lfs_emubd_erase(const struct lfs_config *cfg, lfs_block_t block) {
         if (b->wear >= bd->cfg->erase_cycles) {
             if (bd->cfg->badblock_behavior ==
                     LFS_EMUBD_BADBLOCK_ERASEERROR) {
-                LFS_EMUBD_TRACE("lfs_emubd_erase -> %d", LFS_ERR_CORRUPT);
                 return LFS_ERR_CORRUPT;
             } else if (bd->cfg->badblock_behavior ==
                     LFS_EMUBD_BADBLOCK_ERASENOOP) {
-                LFS_EMUBD_TRACE("lfs_emubd_erase -> %d", 0);
                 return 0;
             }
         } else {
@@ -478,33 +509,27 @@ int lfs_emubd_erase(const struct lfs_config *cfg, lfs_block_t block) {
                     (off_t)block*bd->cfg->erase_size,
                     SEEK_SET);
             if (res1 < 0) {
-                int err = -errno;
-                LFS_EMUBD_TRACE("lfs_emubd_erase -> %d", err);
-                return err;
+                return -errno;
             }
 
             ssize_t res2 = write(bd->disk->fd,
                     bd->disk->scratch,
                     bd->cfg->erase_size);
             if (res2 < 0) {
-                int err = -errno;
-                LFS_EMUBD_TRACE("lfs_emubd_erase -> %d", err);
-                return err;
+                return -errno;
             }
         }
     }
 
     // track erases
     bd->erased += bd->cfg->erase_size;
-    if (bd->cfg->erase_sleep) {
+    if (sleep) {
         int err = nanosleep(&(struct timespec){
-                .tv_sec=bd->cfg->erase_sleep/1000000000,
-                .tv_nsec=bd->cfg->erase_sleep%1000000000},
+                .tv_sec=sleep/1000000000,
+                .tv_nsec=sleep%1000000000},
             NULL);
         if (err) {
-            err = -errno;
-            LFS_EMUBD_TRACE("lfs_emubd_erase -> %d", err);
-            return err;
+            return -errno;
         }
     }
 
@@ -514,13 +539,118 @@ int lfs_emubd_erase(const struct lfs_config *cfg, lfs_block_t block) {
         if (bd->power_cycles == 0) {
             int err = lfs_emubd_powerloss(cfg);
             if (err) {
-                LFS_EMUBD_TRACE("lfs_emubd_erase -> %d", err);
                 return err;
             }
         }
     }
 
-    LFS_EMUBD_TRACE("lfs_emubd_erase -> %d", 0);
+    return 0;
+}
+
+
+int lfs_emubd_erase(const struct lfs_config *cfg, lfs_block_t block) {
+    LFS_EMUBD_TRACE("lfs_emubd_erase(%p, 0x%"PRIx32" (%"PRIu32"))",
+            (void*)cfg, block, ((lfs_emubd_t*)cfg->context)->cfg->erase_size);
+    lfs_emubd_t *bd = cfg->context;
+    int err = lfs_emubd_erase_(cfg, block, bd->cfg->erase_sleep);
+    LFS_EMUBD_TRACE("lfs_emubd_erase -> %d", err);
+    return err;
+}
+
+static lfs_emubd_sleep_t lfs_emubd_now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (lfs_emubd_sleep_t)t.tv_sec*1000000000 + t.tv_nsec;
+}
+
+int lfs_emubd_erase_async(const struct lfs_config *cfg, lfs_block_t block) {
+    LFS_EMUBD_TRACE("lfs_emubd_erase_async(%p, 0x%"PRIx32" (%"PRIu32"))",
+            (void*)cfg, block, ((lfs_emubd_t*)cfg->context)->cfg->erase_size);
+    lfs_emubd_t *bd = cfg->context;
+
+    // check if erase is valid
+    LFS_ASSERT(block < bd->cfg->erase_count);
+    LFS_ASSERT(bd->pending_count < bd->cfg->erase_count);
+
+    // queue the erase, the erase itself happens on completion, so anything
+    // that touches the block before then will notice
+    lfs_emubd_pending_t *p = &bd->pending[
+            (bd->pending_off + bd->pending_count) % bd->cfg->erase_count];
+    p->block = block;
+    p->start = lfs_emubd_now();
+    bd->pending_count += 1;
+
+    LFS_EMUBD_TRACE("lfs_emubd_erase_async -> %d", 0);
+    return 0;
+}
+
+int lfs_emubd_complete(const struct lfs_config *cfg, lfs_block_t *block) {
+    LFS_EMUBD_TRACE("lfs_emubd_complete(%p, %p)", (void*)cfg, block);
+    lfs_emubd_t *bd = cfg->context;
+
+    // any erases in flight?
+    LFS_ASSERT(bd->pending_count > 0);
+    lfs_emubd_pending_t p = bd->pending[bd->pending_off];
+    bd->pending_off = (bd->pending_off + 1) % bd->cfg->erase_count;
+    bd->pending_count -= 1;
+    *block = p.block;
+
+    // only sleep for what's left of our erase
+    lfs_emubd_sleep_t sleep = 0;
+    lfs_emubd_sleep_t elapsed = lfs_emubd_now() - p.start;
+    if (elapsed < bd->cfg->erase_sleep) {
+        sleep = bd->cfg->erase_sleep - elapsed;
+    }
+
+    int err = lfs_emubd_erase_(cfg, p.block, sleep);
+    LFS_EMUBD_TRACE("lfs_emubd_complete -> %d", err);
+    return err;
+}
+
+int lfs_emubd_trim(const struct lfs_config *cfg, lfs_block_t block) {
+    LFS_EMUBD_TRACE("lfs_emubd_trim(%p, 0x%"PRIx32" (%"PRIu32"))",
+            (void*)cfg, block, ((lfs_emubd_t*)cfg->context)->cfg->erase_size);
+    lfs_emubd_t *bd = cfg->context;
+
+    // check if trim is valid
+    LFS_ASSERT(block < bd->cfg->erase_count);
+
+    // blocks that were never written have nothing to discard
+    if (!bd->blocks[block]) {
+        LFS_EMUBD_TRACE("lfs_emubd_trim -> %d", 0);
+        return 0;
+    }
+
+    // get the block, keeping its wear
+    lfs_emubd_block_t *b = lfs_emubd_mutblock(cfg, &bd->blocks[block]);
+    if (!b) {
+        LFS_EMUBD_TRACE("lfs_emubd_trim -> %d", LFS_ERR_NOMEM);
+        return LFS_ERR_NOMEM;
+    }
+
+    // discard data
+    memset(b->data, 0, bd->cfg->erase_size);
+
+    // mirror to disk file?
+    if (bd->disk) {
+        off_t res1 = lseek(bd->disk->fd,
+                (off_t)block*bd->cfg->erase_size,
+                SEEK_SET);
+        if (res1 < 0) {
+            int err = -errno;
+            LFS_EMUBD_TRACE("lfs_emubd_trim -> %d", err);
+            return err;
+        }
+
+        ssize_t res2 = write(bd->disk->fd, b->data, bd->cfg->erase_size);
+        if (res2 < 0) {
+            int err = -errno;
+            LFS_EMUBD_TRACE("lfs_emubd_trim -> %d", err);
+            return err;
+        }
+    }
+
+    LFS_EMUBD_TRACE("lfs_emubd_trim -> %d", 0);
     return 0;
 }
 
@@ -720,6 +850,18 @@ int lfs_emubd_copy(const struct lfs_config *cfg, lfs_emubd_t *copy) {
         copy->blocks[i] = lfs_emubd_incblock(bd->blocks[i]);
     }
 
+    // and our in-flight erases
+    copy->pending = malloc(bd->cfg->erase_count * sizeof(lfs_emubd_pending_t));
+    if (!copy->pending) {
+        LFS_EMUBD_TRACE("lfs_emubd_copy -> %d", LFS_ERR_NOMEM);
+        return LFS_ERR_NOMEM;
+    }
+
+    memcpy(copy->pending, bd->pending,
+            bd->cfg->erase_count * sizeof(lfs_emubd_pending_t));
+    copy->pending_off = bd->pending_off;
+    copy->pending_count = bd->pending_count;
+
     // other state
     copy->readed = bd->readed;
     copy->proged = bd->proged;
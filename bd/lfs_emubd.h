@@ -143,6 +143,12 @@ typedef struct lfs_emubd_disk {
     uint8_t *scratch;
 } lfs_emubd_disk_t;
 
+// An erase in flight
+typedef struct lfs_emubd_pending {
+    lfs_block_t block;
+    lfs_emubd_sleep_t start;
+} lfs_emubd_pending_t;
+
 // emubd state
 typedef struct lfs_emubd {
     // array of copy-on-write blocks
@@ -157,6 +163,11 @@ typedef struct lfs_emubd {
     lfs_emubd_block_t *ooo_data;
     lfs_emubd_disk_t *disk;
 
+    // queue of in-flight erases
+    lfs_emubd_pending_t *pending;
+    lfs_size_t pending_off;
+    lfs_size_t pending_count;
+
     const struct lfs_emubd_config *cfg;
 } lfs_emubd_t;
 
@@ -180,12 +191,34 @@ int lfs_emubd_read(const struct lfs_config *cfg, lfs_block_t block,
 int lfs_emubd_prog(const struct lfs_config *cfg, lfs_block_t block,
         lfs_off_t off, const void *buffer, lfs_size_t size);
 
+// Program a list of regions in order
+//
+// Each region must have previously been erased.
+int lfs_emubd_progv(const struct lfs_config *cfg,
+        const struct lfs_segment *segments, lfs_size_t count);
+
 // Erase a block
 //
 // A block must be erased before being programmed. The
 // state of an erased block is undefined.
 int lfs_emubd_erase(const struct lfs_config *cfg, lfs_block_t block);
 
+// Start erasing a block
+//
+// The erase only takes effect once completed with lfs_emubd_complete, and
+// is lost on power-loss. Any artificial erase delay overlaps with whatever
+// happens before completion.
+int lfs_emubd_erase_async(const struct lfs_config *cfg, lfs_block_t block);
+
+// Wait for the oldest erase in flight to finish
+int lfs_emubd_complete(const struct lfs_config *cfg, lfs_block_t *block);
+
+// Trim a block
+//
+// The block's data is discarded and reads back as zeros, as on most FTLs.
+// The block must be erased again before being programmed.
+int lfs_emubd_trim(const struct lfs_config *cfg, lfs_block_t block);
+
 // Sync the block device
 int lfs_emubd_sync(const struct lfs_config *cfg);
 
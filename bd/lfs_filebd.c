@@ -5,8 +5,16 @@
  * Copyright (c) 2017, Arm Limited. All rights reserved.
  * SPDX-License-Identifier: BSD-3-Clause
  */
+#ifdef __linux__
+// needed for fallocate
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#endif
+
 #include "bd/lfs_filebd.h"
 
+#include <stdlib.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
@@ -21,14 +29,15 @@ int lfs_filebd_create(const struct lfs_config *cfg, const char *path,
                 ".read=%p, .prog=%p, .erase=%p, .sync=%p}, "
                 "\"%s\", "
                 "%p {.read_size=%"PRIu32", .prog_size=%"PRIu32", "
-                ".erase_size=%"PRIu32", .erase_count=%"PRIu32"})",
+                ".erase_size=%"PRIu32", .erase_count=%"PRIu32", "
+                ".erase_depth=%"PRIu32"})",
             (void*)cfg, cfg->context,
             (void*)(uintptr_t)cfg->read, (void*)(uintptr_t)cfg->prog,
             (void*)(uintptr_t)cfg->erase, (void*)(uintptr_t)cfg->sync,
             path,
             (void*)bdcfg,
             bdcfg->read_size, bdcfg->prog_size, bdcfg->erase_size,
-            bdcfg->erase_count);
+            bdcfg->erase_count, bdcfg->erase_depth);
     lfs_filebd_t *bd = cfg->context;
     bd->cfg = bdcfg;
 
@@ -45,6 +54,19 @@ int lfs_filebd_create(const struct lfs_config *cfg, const char *path,
         return err;
     }
 
+    // allocate our queue of in-flight erases, if any
+    bd->pending = NULL;
+    if (bd->cfg->erase_depth) {
+        bd->pending = malloc(bd->cfg->erase_depth * sizeof(lfs_block_t));
+        if (!bd->pending) {
+            close(bd->fd);
+            LFS_FILEBD_TRACE("lfs_filebd_create -> %d", LFS_ERR_NOMEM);
+            return LFS_ERR_NOMEM;
+        }
+    }
+    bd->pending_off = 0;
+    bd->pending_count = 0;
+
     LFS_FILEBD_TRACE("lfs_filebd_create -> %d", 0);
     return 0;
 }
@@ -52,6 +74,7 @@ int lfs_filebd_create(const struct lfs_config *cfg, const char *path,
 int lfs_filebd_destroy(const struct lfs_config *cfg) {
     LFS_FILEBD_TRACE("lfs_filebd_destroy(%p)", (void*)cfg);
     lfs_filebd_t *bd = cfg->context;
+    free(bd->pending);
     int err = close(bd->fd);
     if (err < 0) {
         err = -errno;
@@ -146,6 +169,67 @@ int lfs_filebd_erase(const struct lfs_config *cfg, lfs_block_t block) {
     return 0;
 }
 
+int lfs_filebd_erase_async(const struct lfs_config *cfg, lfs_block_t block) {
+    LFS_FILEBD_TRACE("lfs_filebd_erase_async(%p, 0x%"PRIx32" (%"PRIu32"))",
+            (void*)cfg, block, ((lfs_filebd_t*)cfg->context)->cfg->erase_size);
+    lfs_filebd_t *bd = cfg->context;
+
+    // check if erase is valid
+    LFS_ASSERT(block < bd->cfg->erase_count);
+    LFS_ASSERT(bd->pending_count < bd->cfg->erase_depth);
+
+    // queue the erase
+    bd->pending[(bd->pending_off + bd->pending_count)
+            % bd->cfg->erase_depth] = block;
+    bd->pending_count += 1;
+
+    LFS_FILEBD_TRACE("lfs_filebd_erase_async -> %d", 0);
+    return 0;
+}
+
+int lfs_filebd_complete(const struct lfs_config *cfg, lfs_block_t *block) {
+    LFS_FILEBD_TRACE("lfs_filebd_complete(%p, %p)", (void*)cfg, block);
+    lfs_filebd_t *bd = cfg->context;
+
+    // any erases in flight?
+    LFS_ASSERT(bd->pending_count > 0);
+    *block = bd->pending[bd->pending_off];
+    bd->pending_off = (bd->pending_off + 1) % bd->cfg->erase_depth;
+    bd->pending_count -= 1;
+
+    // erase is a noop, so it has always finished by now
+    int err = lfs_filebd_erase(cfg, *block);
+    LFS_FILEBD_TRACE("lfs_filebd_complete -> %d", err);
+    return err;
+}
+
+int lfs_filebd_trim(const struct lfs_config *cfg, lfs_block_t block) {
+    LFS_FILEBD_TRACE("lfs_filebd_trim(%p, 0x%"PRIx32" (%"PRIu32"))",
+            (void*)cfg, block, ((lfs_filebd_t*)cfg->context)->cfg->erase_size);
+    lfs_filebd_t *bd = cfg->context;
+
+    // check if trim is valid
+    LFS_ASSERT(block < bd->cfg->erase_count);
+
+    #if defined(__linux__) && defined(FALLOC_FL_PUNCH_HOLE)
+    // punch a hole, keeping the file's size, filesystems that don't
+    // support this just keep the old data
+    int err = fallocate(bd->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+            (off_t)block*bd->cfg->erase_size, bd->cfg->erase_size);
+    if (err && errno != EOPNOTSUPP) {
+        err = -errno;
+        LFS_FILEBD_TRACE("lfs_filebd_trim -> %d", err);
+        return err;
+    }
+    #else
+    // trim is a noop
+    (void)bd;
+    #endif
+
+    LFS_FILEBD_TRACE("lfs_filebd_trim -> %d", 0);
+    return 0;
+}
+
 int lfs_filebd_sync(const struct lfs_config *cfg) {
     LFS_FILEBD_TRACE("lfs_filebd_sync(%p)", (void*)cfg);
 
@@ -39,11 +39,21 @@ struct lfs_filebd_config {
 
     // Number of erase blocks on the device.
     lfs_size_t erase_count;
+
+    // Number of erases that may be in flight at once. This should match
+    // the erase_depth in lfs_config. Zero disables lfs_filebd_erase_async.
+    lfs_size_t erase_depth;
 };
 
 // filebd state
 typedef struct lfs_filebd {
     int fd;
+
+    // queue of in-flight erases
+    lfs_block_t *pending;
+    lfs_size_t pending_off;
+    lfs_size_t pending_count;
+
     const struct lfs_filebd_config *cfg;
 } lfs_filebd_t;
 
@@ -71,6 +81,21 @@ int lfs_filebd_prog(const struct lfs_config *cfg, lfs_block_t block,
 // state of an erased block is undefined.
 int lfs_filebd_erase(const struct lfs_config *cfg, lfs_block_t block);
 
+// Start erasing a block
+//
+// Like lfs_filebd_erase, but the erase is only reported as finished by
+// lfs_filebd_complete.
+int lfs_filebd_erase_async(const struct lfs_config *cfg, lfs_block_t block);
+
+// Wait for the oldest erase in flight to finish
+int lfs_filebd_complete(const struct lfs_config *cfg, lfs_block_t *block);
+
+// Trim a block
+//
+// Where supported, punches a hole in the file so unused blocks take no
+// space on disk, and reads back as zeros. Otherwise this is a noop.
+int lfs_filebd_trim(const struct lfs_config *cfg, lfs_block_t block);
+
 // Sync the block device
 int lfs_filebd_sync(const struct lfs_config *cfg);
 
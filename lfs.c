@@ -41,6 +41,190 @@ static inline void lfs_cache_zero(lfs_t *lfs, lfs_cache_t *pcache) {
     pcache->block = LFS_BLOCK_NULL;
 }
 
+#ifdef LFS_READCACHE
+static void lfs_cache_touch(lfs_t *lfs, lfs_size_t i) {
+    // move a read cache line to the front, lines are kept in
+    // most-recently-used order so the last line is always the victim
+    if (i > 0) {
+        lfs_cache_t line = lfs->rlines[i];
+        memmove(&lfs->rlines[1], &lfs->rlines[0], i*sizeof(lfs_cache_t));
+        lfs->rlines[0] = line;
+    }
+}
+
+static void lfs_cache_fill(lfs_t *lfs, const lfs_cache_t *rcache) {
+    // copy a freshly loaded rcache into the least-recently-used line, lines
+    // never alias rcache, so they only ever hold what is on disk
+    lfs_size_t i = lfs->cfg->read_cache_count - 1;
+    lfs->rlines[i].block = rcache->block;
+    lfs->rlines[i].off = rcache->off;
+    lfs->rlines[i].size = rcache->size;
+    memcpy(lfs->rlines[i].buffer, rcache->buffer, rcache->size);
+    lfs_cache_touch(lfs, i);
+}
+#endif
+
+#ifndef LFS_READONLY
+static void lfs_cache_dropblock(lfs_t *lfs, lfs_block_t block) {
+    #ifdef LFS_READCACHE
+    // drop any read cache lines that no longer match the disk
+    for (lfs_size_t i = 0; i < lfs->cfg->read_cache_count; i++) {
+        if (lfs->rlines[i].block == block) {
+            lfs_cache_drop(lfs, &lfs->rlines[i]);
+        }
+    }
+    #endif
+
+    #ifdef LFS_MDIRCACHE
+    // and any fetched mdirs that live in the block
+    for (lfs_size_t i = 0; i < lfs->cfg->mdir_cache_count; i++) {
+        if (lfs->mdirs[i].pair[0] == block
+                || lfs->mdirs[i].pair[1] == block) {
+            lfs->mdirs[i].pair[0] = LFS_BLOCK_NULL;
+            lfs->mdirs[i].pair[1] = LFS_BLOCK_NULL;
+        }
+    }
+    #endif
+
+    (void)lfs;
+    (void)block;
+}
+#endif
+
+#if !defined(LFS_READONLY) && defined(LFS_ASYNCERASE)
+static bool lfs_bd_inflight(lfs_t *lfs, lfs_block_t block) {
+    for (lfs_size_t i = 0; i < lfs->inflight.count; i++) {
+        if (lfs->inflight.blocks[
+                (lfs->inflight.off + i) % lfs->cfg->erase_depth] == block) {
+            return true;
+        }
+    }
+
+    return false;
+}
+#endif
+
+#ifndef LFS_READONLY
+static int lfs_bd_complete(lfs_t *lfs, lfs_block_t block) {
+    #ifdef LFS_ASYNCERASE
+    // wait for in-flight erases until block is no longer in flight,
+    // LFS_BLOCK_NULL waits for all of them
+    while (lfs->inflight.count > 0
+            && (block == LFS_BLOCK_NULL || lfs_bd_inflight(lfs, block))) {
+        lfs_block_t done = LFS_BLOCK_NULL;
+        int err = lfs->cfg->complete(lfs->cfg, &done);
+        LFS_ASSERT(err <= 0);
+        LFS_ASSERT(done == lfs->inflight.blocks[lfs->inflight.off]);
+        lfs->inflight.off = (lfs->inflight.off + 1) % lfs->cfg->erase_depth;
+        lfs->inflight.count -= 1;
+
+        if (err == LFS_ERR_CORRUPT) {
+            // remember bad erases until the block is programmed, this is
+            // where a synchronous erase would have reported it, lfs_bd_erase
+            // never lets in-flight and bad erases outgrow erase_depth
+            lfs_block_t *bad = &lfs->inflight.blocks[lfs->cfg->erase_depth];
+            LFS_ASSERT(lfs->inflight.bad_count < lfs->cfg->erase_depth);
+            bad[lfs->inflight.bad_count] = done;
+            lfs->inflight.bad_count += 1;
+        } else if (err) {
+            return err;
+        }
+    }
+    #else
+    // nothing is ever in flight without asynchronous erases
+    (void)lfs;
+    (void)block;
+    #endif
+
+    return 0;
+}
+#endif
+
+#if !defined(LFS_READONLY) && defined(LFS_ASYNCERASE)
+static bool lfs_bd_takebad(lfs_t *lfs, lfs_block_t block) {
+    // did an asynchronous erase of this block fail?
+    lfs_block_t *bad = &lfs->inflight.blocks[lfs->cfg->erase_depth];
+    for (lfs_size_t i = 0; i < lfs->inflight.bad_count; i++) {
+        if (bad[i] == block) {
+            memmove(&bad[i], &bad[i+1],
+                    (lfs->inflight.bad_count-1-i)*sizeof(lfs_block_t));
+            lfs->inflight.bad_count -= 1;
+            return true;
+        }
+    }
+
+    return false;
+}
+#endif
+
+#ifndef LFS_READONLY
+static int lfs_bd_wait(lfs_t *lfs, lfs_block_t block) {
+    // wait for any in-flight erase of a block we're about to program, and
+    // report it here if it failed
+    int err = lfs_bd_complete(lfs, block);
+    if (err) {
+        return err;
+    }
+
+    #ifdef LFS_ASYNCERASE
+    if (lfs_bd_takebad(lfs, block)) {
+        return LFS_ERR_CORRUPT;
+    }
+    #endif
+
+    return 0;
+}
+#endif
+
+#if !defined(LFS_READONLY) && defined(LFS_TRIM)
+static void lfs_bd_untrim(lfs_t *lfs, lfs_block_t block) {
+    // forget any pending trim of a block we're about to reuse
+    for (lfs_size_t i = 0; i < lfs->trim.count; i++) {
+        if (lfs->trim.blocks[i] == block) {
+            memmove(&lfs->trim.blocks[i], &lfs->trim.blocks[i+1],
+                    (lfs->trim.count-1-i)*sizeof(lfs_block_t));
+            lfs->trim.count -= 1;
+            return;
+        }
+    }
+}
+#endif
+
+#if !defined(LFS_READONLY) && defined(LFS_TRIM)
+static int lfs_bd_trim(lfs_t *lfs) {
+    // trim any freed blocks, oldest first
+    while (lfs->trim.count > 0) {
+        int err = lfs->cfg->trim(lfs->cfg, lfs->trim.blocks[0]);
+        LFS_ASSERT(err <= 0);
+        if (err) {
+            return err;
+        }
+
+        memmove(&lfs->trim.blocks[0], &lfs->trim.blocks[1],
+                (lfs->trim.count-1)*sizeof(lfs_block_t));
+        lfs->trim.count -= 1;
+    }
+
+    return 0;
+}
+#endif
+
+#if !defined(LFS_READONLY) && defined(LFS_PREERASE)
+static bool lfs_bd_takeerased(lfs_t *lfs, lfs_block_t block) {
+    // was this block erased ahead of time?
+    for (lfs_size_t i = 0; i < lfs->preerase.count; i++) {
+        if (lfs->preerase.blocks[i] == block) {
+            lfs->preerase.blocks[i]
+                    = lfs->preerase.blocks[lfs->preerase.count-1];
+            lfs->preerase.count -= 1;
+            return true;
+        }
+    }
+
+    return false;
+}
+#endif
+
 static int lfs_bd_read(lfs_t *lfs,
         const lfs_cache_t *pcache, lfs_cache_t *rcache, lfs_size_t hint,
         lfs_block_t block, lfs_off_t off,
@@ -71,6 +255,39 @@ static int lfs_bd_read(lfs_t *lfs,
             diff = lfs_min(diff, pcache->off-off);
         }
 
+        #if defined(LFS_PROGV) || defined(LFS_READCACHE)
+        bool hit = false;
+        #endif
+
+        #ifdef LFS_PROGV
+        for (lfs_size_t i = 0;
+                pcache == &lfs->pcache && i < lfs->pbatch_count; i++) {
+            const struct lfs_segment *seg = &lfs->pbatch[i];
+            if (block == seg->block &&
+                    off < seg->off + seg->size) {
+                if (off >= seg->off) {
+                    // is already in a batched prog?
+                    diff = lfs_min(diff, seg->size - (off-seg->off));
+                    memcpy(data,
+                            &((const uint8_t*)seg->buffer)[off-seg->off],
+                            diff);
+                    hit = true;
+                    break;
+                }
+
+                // batched progs take priority
+                diff = lfs_min(diff, seg->off-off);
+            }
+        }
+
+        if (hit) {
+            data += diff;
+            off += diff;
+            size -= diff;
+            continue;
+        }
+        #endif
+
         if (block == rcache->block &&
                 off < rcache->off + rcache->size) {
             if (off >= rcache->off) {
@@ -88,6 +305,43 @@ static int lfs_bd_read(lfs_t *lfs,
             diff = lfs_min(diff, rcache->off-off);
         }
 
+        #ifdef LFS_READCACHE
+        for (lfs_size_t i = 0; i < lfs->cfg->read_cache_count; i++) {
+            lfs_cache_t *line = &lfs->rlines[i];
+            if (block == line->block &&
+                    off < line->off + line->size) {
+                if (off >= line->off) {
+                    // is already in a read cache line?
+                    diff = lfs_min(diff, line->size - (off-line->off));
+                    memcpy(data, &line->buffer[off-line->off], diff);
+                    lfs_cache_touch(lfs, i);
+                    hit = true;
+                    break;
+                }
+
+                // read cache lines take priority
+                diff = lfs_min(diff, line->off-off);
+            }
+        }
+
+        if (hit) {
+            data += diff;
+            off += diff;
+            size -= diff;
+            continue;
+        }
+        #endif
+
+        #if !defined(LFS_READONLY) && defined(LFS_ASYNCERASE)
+        if (lfs->inflight.count > 0) {
+            // make sure any in-flight erase of this block has finished
+            int err = lfs_bd_complete(lfs, block);
+            if (err) {
+                return err;
+            }
+        }
+        #endif
+
         if (size >= hint && off % lfs->cfg->read_size == 0 &&
                 size >= lfs->cfg->read_size) {
             // bypass cache?
@@ -117,8 +371,17 @@ static int lfs_bd_read(lfs_t *lfs,
                 rcache->off, rcache->buffer, rcache->size);
         LFS_ASSERT(err <= 0);
         if (err) {
+            // don't leave a failed read in our cache, we may not evict it
+            // before it's read again if read cache lines are hitting
+            lfs_cache_drop(lfs, rcache);
             return err;
         }
+
+        #ifdef LFS_READCACHE
+        if (lfs->cfg->read_cache_count > 0) {
+            lfs_cache_fill(lfs, rcache);
+        }
+        #endif
     }
 
     return 0;
@@ -151,26 +414,225 @@ static int lfs_bd_cmp(lfs_t *lfs,
     return LFS_CMP_EQ;
 }
 
+#ifdef LFS_CRCRUNS
+// crc runs in O(log n), this works in GF(2) modulo the crc polynomial,
+// where appending n bytes multiplies the crc by x^(8n)
+//
+// x^(2^k) mod p(x), for k = 0..31
+static const uint32_t lfs_crc_x2n[32] = {
+    0x40000000, 0x20000000, 0x08000000, 0x00800000,
+    0x00008000, 0xedb88320, 0xb1e6b092, 0xa06a2517,
+    0xed627dae, 0x88d14467, 0xd7bbfe6a, 0xec447f11,
+    0x8e7ea170, 0x6427800e, 0x4d47bae0, 0x09fe548f,
+    0x83852d0f, 0x30362f1a, 0x7b5a9cc3, 0x31fec169,
+    0x9fec022a, 0x6c8dedc4, 0x15d6874d, 0x5fde7a4e,
+    0xbad90e37, 0x2e4e5eef, 0x4eaba214, 0xa8a472c0,
+    0x429a969e, 0x148d302a, 0xc40ba6d0, 0xc4e22c3c,
+};
+
+// multiply a and b modulo p(x)
+static uint32_t lfs_crc_multmodp(uint32_t a, uint32_t b) {
+    uint32_t p = 0;
+    for (uint32_t m = 0x80000000; m; m >>= 1) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m-1)) == 0) {
+                break;
+            }
+        }
+
+        b = (b >> 1) ^ ((b & 1) ? 0xedb88320 : 0);
+    }
+
+    return p;
+}
+
+// find the crc of two concatenated buffers from the crc of each, crc2 must
+// be the crc of the second buffer starting from 0
+static uint32_t lfs_crc_combine(uint32_t crc1,
+        uint32_t crc2, lfs_size_t size2) {
+    for (unsigned k = 3; size2; size2 >>= 1, k++) {
+        if (size2 & 1) {
+            crc1 = lfs_crc_multmodp(lfs_crc_x2n[k & 31], crc1);
+        }
+    }
+
+    return crc1 ^ crc2;
+}
+
+// find the crc of size copies of the byte c
+static uint32_t lfs_crc_const(uint32_t crc, uint8_t c, lfs_size_t size) {
+    // small runs are cheaper to just crc
+    if (size < 64) {
+        for (lfs_size_t i = 0; i < size; i++) {
+            crc = lfs_crc(crc, &c, 1);
+        }
+
+        return crc;
+    }
+
+    // append runs of 2^k bytes for each bit in size, every byte is the same
+    // so order doesn't matter, g holds the crc of 2^k bytes from zero
+    uint32_t g = lfs_crc(0, &c, 1);
+    uint32_t run = 0;
+    for (lfs_size_t n = size, k = 3; n; k++) {
+        if (n & 1) {
+            run = lfs_crc_multmodp(lfs_crc_x2n[k & 31], run) ^ g;
+        }
+
+        n >>= 1;
+        if (n) {
+            g = lfs_crc_multmodp(lfs_crc_x2n[k & 31], g) ^ g;
+        }
+    }
+
+    return lfs_crc_combine(crc, run, size);
+}
+#endif
+
 static int lfs_bd_crc(lfs_t *lfs,
         const lfs_cache_t *pcache, lfs_cache_t *rcache, lfs_size_t hint,
         lfs_block_t block, lfs_off_t off, lfs_size_t size, uint32_t *crc) {
     lfs_size_t diff = 0;
+    #ifdef LFS_CRCRUNS
+    // runs of a repeated byte, such as erased data, are crced in
+    // O(log n) when the run ends
+    uint8_t run = 0;
+    lfs_size_t runsize = 0;
+    #endif
+    int err = 0;
 
     for (lfs_off_t i = 0; i < size; i += diff) {
         uint8_t dat[8];
         diff = lfs_min(size-i, sizeof(dat));
-        int err = lfs_bd_read(lfs,
+        err = lfs_bd_read(lfs,
                 pcache, rcache, hint-i,
                 block, off+i, &dat, diff);
         if (err) {
-            return err;
+            break;
         }
 
+        #ifdef LFS_CRCRUNS
+        // part of a run? runs only pay off if they're long enough to skip
+        // the byte-wise crc, so don't bother looking in small regions
+        if (size >= 64 && diff == sizeof(dat)
+                && memcmp(&dat[0], &dat[1], sizeof(dat)-1) == 0
+                && (runsize == 0 || dat[0] == run)) {
+            run = dat[0];
+            runsize += diff;
+            continue;
+        }
+
+        if (runsize > 0) {
+            *crc = lfs_crc_const(*crc, run, runsize);
+            runsize = 0;
+        }
+        #endif
+
         *crc = lfs_crc(*crc, &dat, diff);
     }
 
+    #ifdef LFS_CRCRUNS
+    // some callers still use the crc on error, so make sure it includes
+    // everything we've read
+    if (runsize > 0) {
+        *crc = lfs_crc_const(*crc, run, runsize);
+    }
+    #endif
+
+    return err;
+}
+
+#ifndef LFS_READONLY
+static int lfs_bd_progv(lfs_t *lfs, const lfs_cache_t *pcache) {
+    #ifdef LFS_PROGV
+    // hand any batched progs, and optionally the pcache, to progv
+    lfs_size_t count = lfs->pbatch_count;
+    if (pcache) {
+        lfs->pbatch[count].block = pcache->block;
+        lfs->pbatch[count].off = pcache->off;
+        lfs->pbatch[count].buffer = pcache->buffer;
+        lfs->pbatch[count].size = lfs_alignup(pcache->size,
+                lfs->cfg->prog_size);
+        count += 1;
+    }
+
+    if (count == 0) {
+        return 0;
+    }
+
+    for (lfs_size_t i = 0; i < count; i++) {
+        lfs_cache_dropblock(lfs, lfs->pbatch[i].block);
+    }
+
+    // batches only ever target one block
+    int err = lfs_bd_wait(lfs, lfs->pbatch[0].block);
+    lfs->pbatch_count = 0;
+    if (err) {
+        return err;
+    }
+
+    err = lfs->cfg->progv(lfs->cfg, lfs->pbatch, count);
+    LFS_ASSERT(err <= 0);
+
+    // restore our batch buffers
+    uint8_t *buffer = (uint8_t*)&lfs->pbatch[lfs->cfg->prog_batch_count+1];
+    for (lfs_size_t i = 0; i < lfs->cfg->prog_batch_count; i++) {
+        lfs->pbatch[i].buffer = &buffer[i*lfs->cfg->cache_size];
+    }
+
+    return err;
+    #else
+    // nothing is ever batched without progv
+    (void)lfs;
+    (void)pcache;
+    return 0;
+    #endif
+}
+#endif
+
+#ifndef LFS_READONLY
+static int lfs_bd_progdirect(lfs_t *lfs,
+        lfs_cache_t *rcache, bool validate,
+        lfs_block_t block, lfs_off_t off,
+        const void *buffer, lfs_size_t size) {
+    // progs we validate can't be batched, but we still need to keep
+    // progs in order
+    int err = lfs_bd_progv(lfs, NULL);
+    if (err) {
+        return err;
+    }
+
+    lfs_cache_dropblock(lfs, block);
+    err = lfs_bd_wait(lfs, block);
+    if (err) {
+        return err;
+    }
+
+    err = lfs->cfg->prog(lfs->cfg, block, off, buffer, size);
+    LFS_ASSERT(err <= 0);
+    if (err) {
+        return err;
+    }
+
+    if (validate) {
+        // check data on disk
+        lfs_cache_drop(lfs, rcache);
+        int res = lfs_bd_cmp(lfs,
+                NULL, rcache, size,
+                block, off, buffer, size);
+        if (res < 0) {
+            return res;
+        }
+
+        if (res != LFS_CMP_EQ) {
+            return LFS_ERR_CORRUPT;
+        }
+    }
+
     return 0;
 }
+#endif
 
 #ifndef LFS_READONLY
 static int lfs_bd_flush(lfs_t *lfs,
@@ -178,27 +640,50 @@ static int lfs_bd_flush(lfs_t *lfs,
     if (pcache->block != LFS_BLOCK_NULL && pcache->block != LFS_BLOCK_INLINE) {
         LFS_ASSERT(pcache->block < lfs->block_count);
         lfs_size_t diff = lfs_alignup(pcache->size, lfs->cfg->prog_size);
-        int err = lfs->cfg->prog(lfs->cfg, pcache->block,
-                pcache->off, pcache->buffer, diff);
-        LFS_ASSERT(err <= 0);
-        if (err) {
-            return err;
-        }
 
-        if (validate) {
-            // check data on disk
-            lfs_cache_drop(lfs, rcache);
-            int res = lfs_bd_cmp(lfs,
-                    NULL, rcache, diff,
-                    pcache->block, pcache->off, pcache->buffer, diff);
-            if (res < 0) {
-                return res;
+        #ifdef LFS_PROGV
+        if (lfs->cfg->prog_batch_count > 0) {
+            // only batch progs to the same block, so errors can be
+            // attributed to a single block
+            if (lfs->pbatch_count > 0
+                    && lfs->pbatch[0].block != pcache->block) {
+                int err = lfs_bd_progv(lfs, NULL);
+                if (err) {
+                    return err;
+                }
             }
 
-            if (res != LFS_CMP_EQ) {
-                return LFS_ERR_CORRUPT;
+            if (pcache == &lfs->pcache && !validate) {
+                if (lfs->pbatch_count < lfs->cfg->prog_batch_count) {
+                    // batch until our next sync
+                    struct lfs_segment *seg
+                            = &lfs->pbatch[lfs->pbatch_count];
+                    seg->block = pcache->block;
+                    seg->off = pcache->off;
+                    seg->size = diff;
+                    memcpy((uint8_t*)seg->buffer, pcache->buffer, diff);
+                    lfs->pbatch_count += 1;
+                    lfs_cache_zero(lfs, pcache);
+                    return 0;
+                }
+
+                // out of batch buffers, submit everything
+                int err = lfs_bd_progv(lfs, pcache);
+                if (err) {
+                    return err;
+                }
+
+                lfs_cache_zero(lfs, pcache);
+                return 0;
             }
         }
+        #endif
+
+        int err = lfs_bd_progdirect(lfs, rcache, validate,
+                pcache->block, pcache->off, pcache->buffer, diff);
+        if (err) {
+            return err;
+        }
 
         lfs_cache_zero(lfs, pcache);
     }
@@ -212,11 +697,38 @@ static int lfs_bd_sync(lfs_t *lfs,
         lfs_cache_t *pcache, lfs_cache_t *rcache, bool validate) {
     lfs_cache_drop(lfs, rcache);
 
+    #ifdef LFS_PROGV
+    if (lfs->pbatch_count > 0 && pcache == &lfs->pcache && !validate
+            && (pcache->block == LFS_BLOCK_NULL
+                || pcache->block == lfs->pbatch[0].block)) {
+        // submit batched progs and pcache together
+        int err = lfs_bd_progv(lfs,
+                (pcache->block != LFS_BLOCK_NULL) ? pcache : NULL);
+        if (err) {
+            return err;
+        }
+
+        lfs_cache_zero(lfs, pcache);
+    }
+    #endif
+
     int err = lfs_bd_flush(lfs, pcache, rcache, validate);
     if (err) {
         return err;
     }
 
+    // make sure nothing is left batched
+    err = lfs_bd_progv(lfs, NULL);
+    if (err) {
+        return err;
+    }
+
+    // and nothing is left in flight
+    err = lfs_bd_complete(lfs, LFS_BLOCK_NULL);
+    if (err) {
+        return err;
+    }
+
     err = lfs->cfg->sync(lfs->cfg);
     LFS_ASSERT(err <= 0);
     return err;
@@ -261,6 +773,30 @@ static int lfs_bd_prog(lfs_t *lfs,
         // entire block or manually flushing the pcache
         LFS_ASSERT(pcache->block == LFS_BLOCK_NULL);
 
+        #ifdef LFS_DIRECTIO
+        if (pcache != &lfs->pcache && block != LFS_BLOCK_INLINE
+                && off % lfs->cfg->cache_size == 0
+                && size >= lfs->cfg->cache_size) {
+            // bypass cache? note the shared pcache is reserved for
+            // metadata, which may be batched, and inline files must stay
+            // in their cache
+            //
+            // we only bypass whole cache-sized units so the pcache stays
+            // aligned, and is flushed when it reaches the end of the block
+            lfs_size_t diff = lfs_aligndown(size, lfs->cfg->cache_size);
+            int err = lfs_bd_progdirect(lfs, rcache, validate,
+                    block, off, data, diff);
+            if (err) {
+                return err;
+            }
+
+            data += diff;
+            off += diff;
+            size -= diff;
+            continue;
+        }
+        #endif
+
         // prepare pcache, first condition can no longer fail
         pcache->block = block;
         pcache->off = lfs_aligndown(off, lfs->cfg->prog_size);
@@ -271,10 +807,92 @@ static int lfs_bd_prog(lfs_t *lfs,
 }
 #endif
 
+#if !defined(LFS_READONLY) && defined(LFS_WEAR)
+// count an erase in our wear table
+static void lfs_bd_wear(lfs_t *lfs, lfs_block_t block) {
+    LFS_ASSERT(lfs->cfg->wear_size >= lfs->block_count);
+    if (lfs->wear[block] == 0xff) {
+        // halve every count when we saturate, we only care about how
+        // worn blocks are relative to each other
+        for (lfs_block_t i = 0; i < lfs->block_count; i++) {
+            lfs->wear[i] >>= 1;
+        }
+    }
+
+    lfs->wear[block] += 1;
+}
+#endif
+
 #ifndef LFS_READONLY
 static int lfs_bd_erase(lfs_t *lfs, lfs_block_t block) {
     LFS_ASSERT(block < lfs->block_count);
-    int err = lfs->cfg->erase(lfs->cfg, block);
+    #ifdef LFS_TRIM
+    lfs_bd_untrim(lfs, block);
+    #endif
+
+    #ifdef LFS_PREERASE
+    // nothing to do if we erased this block ahead of time, it's been free,
+    // and so untouched, since then
+    if (lfs_bd_takeerased(lfs, block)) {
+        return 0;
+    }
+    #endif
+
+    // keep erases ordered after any batched progs
+    int err = lfs_bd_progv(lfs, NULL);
+    if (err) {
+        return err;
+    }
+
+    #ifdef LFS_WEAR
+    if (lfs->cfg->wear_size) {
+        lfs_bd_wear(lfs, block);
+    }
+    #endif
+
+    lfs_cache_dropblock(lfs, block);
+    #ifdef LFS_ASYNCERASE
+    if (lfs->cfg->erase_depth > 0) {
+        // make room in our queue, and keep erases to the same
+        // block ordered
+        if (lfs->inflight.count == lfs->cfg->erase_depth) {
+            err = lfs_bd_complete(lfs,
+                    lfs->inflight.blocks[lfs->inflight.off]);
+            if (err) {
+                return err;
+            }
+        }
+
+        err = lfs_bd_complete(lfs, block);
+        if (err) {
+            return err;
+        }
+
+        // erasing again, so any earlier bad erase no longer matters
+        lfs_bd_takebad(lfs, block);
+
+        // start the erase, we only need to wait for it when the
+        // block is read or programmed, but only if there is room to
+        // remember it failing, otherwise fall back to a synchronous erase
+        // until the bad erases we're holding onto are reported
+        if (lfs->inflight.count + lfs->inflight.bad_count
+                < lfs->cfg->erase_depth) {
+            err = lfs->cfg->erase_async(lfs->cfg, block);
+            LFS_ASSERT(err <= 0);
+            if (err) {
+                return err;
+            }
+
+            lfs->inflight.blocks[
+                    (lfs->inflight.off + lfs->inflight.count)
+                        % lfs->cfg->erase_depth] = block;
+            lfs->inflight.count += 1;
+            return 0;
+        }
+    }
+    #endif
+
+    err = lfs->cfg->erase(lfs->cfg, block);
     LFS_ASSERT(err <= 0);
     return err;
 }
@@ -411,11 +1029,11 @@ static inline bool lfs_gstate_hasorphans(const lfs_gstate_t *a) {
 static inline uint8_t lfs_gstate_getorphans(const lfs_gstate_t *a) {
     return lfs_tag_size(a->tag) & 0x1ff;
 }
+#endif
 
 static inline bool lfs_gstate_hasmove(const lfs_gstate_t *a) {
     return lfs_tag_type1(a->tag);
 }
-#endif
 
 static inline bool lfs_gstate_needssuperblock(const lfs_gstate_t *a) {
     return lfs_tag_size(a->tag) >> 9;
@@ -518,6 +1136,21 @@ static void lfs_mlist_append(lfs_t *lfs, struct lfs_mlist *mlist) {
     lfs->mlist = mlist;
 }
 
+#if !defined(LFS_READONLY) \
+        && (defined(LFS_BITMAP) || defined(LFS_TRIM) || defined(LFS_USEDCOUNT))
+static bool lfs_mlist_isshared(lfs_t *lfs, struct lfs_mlist *node,
+        const lfs_block_t pair[2], uint16_t id) {
+    for (struct lfs_mlist *p = lfs->mlist; p; p = p->next) {
+        if (p != node && p->type == LFS_TYPE_REG && p->id == id
+                && lfs_pair_cmp(p->m.pair, pair) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+#endif
+
 // some other filesystem operations
 static uint32_t lfs_fs_disk_version(lfs_t *lfs) {
     (void)lfs;
@@ -600,27 +1233,197 @@ static int lfs_unmount_(lfs_t *lfs);
 // after a checkpoint, the block allocator may realloc any untracked blocks
 static void lfs_alloc_ckpoint(lfs_t *lfs) {
     lfs->lookahead.ckpoint = lfs->block_count;
+    #ifdef LFS_BITMAP
+    lfs->bitmap.ckpoint = lfs->bitmap.next;
+    #endif
+}
+
+#ifndef LFS_READONLY
+// adjust our count of in-use blocks, if we have one, this may drift from
+// the real count and is corrected during lfs_fs_gc
+static void lfs_alloc_count(lfs_t *lfs, lfs_block_t count, bool used) {
+    #ifdef LFS_USEDCOUNT
+    if (lfs->used == LFS_BLOCK_NULL) {
+        return;
+    }
+
+    if (used) {
+        lfs->used += count;
+    } else {
+        lfs->used -= lfs_min(count, lfs->used);
+    }
+    #else
+    (void)lfs;
+    (void)count;
+    (void)used;
+    #endif
+}
+#endif
+
+// forget any blocks reserved for open files' extents, this is done
+// whenever we rebuild our view of free blocks, since reserved blocks are
+// only tracked there
+//
+// blocks reserved with lfs_file_reserve are kept, these are marked again
+// by lfs_alloc_markreserved
+static void lfs_alloc_dropextents(lfs_t *lfs) {
+    #if !defined(LFS_READONLY) && defined(LFS_EXTENTS)
+    for (lfs_file_t *f = (lfs_file_t*)lfs->mlist; f; f = f->next) {
+        if (f->type == LFS_TYPE_REG && !f->extent.reserved) {
+            lfs_alloc_count(lfs, f->extent.count, false);
+            f->extent.count = 0;
+        }
+    }
+    #else
+    (void)lfs;
+    #endif
 }
 
 // drop the lookahead buffer, this is done during mounting and failed
 // traversals in order to avoid invalid lookahead state
 static void lfs_alloc_drop(lfs_t *lfs) {
+    lfs_alloc_dropextents(lfs);
+    #ifdef LFS_USEDCOUNT
+    lfs->used = LFS_BLOCK_NULL;
+    #endif
     lfs->lookahead.size = 0;
     lfs->lookahead.next = 0;
+    #ifdef LFS_SUMMARY
+    lfs->summary.remaining = 0;
+    #endif
+    #ifdef LFS_BITMAP
+    lfs->bitmap.size = 0;
+    #endif
     lfs_alloc_ckpoint(lfs);
 }
 
+#ifndef LFS_READONLY
+// find the first free block in a bitmap of in-use blocks in the range
+// [off, size), or the first in-use block if used is true, returns size if
+// there are no such blocks
+//
+// we search a 32-bit word at a time, so runs of in-use blocks can be
+// skipped without testing every bit
+static lfs_block_t lfs_alloc_findbit(const uint8_t *buffer,
+        lfs_block_t off, lfs_block_t size, bool used) {
+    lfs_size_t bytes = (size+7)/8;
+    while (off < size) {
+        lfs_size_t i = 4*(off / 32);
+        uint32_t word = 0;
+        if (i+4 <= bytes) {
+            memcpy(&word, &buffer[i], 4);
+            word = lfs_fromle32(word);
+        } else {
+            // bits past size read as free, these are clamped below
+            for (lfs_size_t j = i; j < bytes; j++) {
+                word |= (uint32_t)buffer[j] << 8*(j-i);
+            }
+        }
+
+        // ignore any blocks before off
+        word = (used ? word : ~word) & (0xffffffff << (off % 32));
+        if (word) {
+            return lfs_min(8*i + lfs_ctz(word), size);
+        }
+
+        off = 8*(i+4);
+    }
+
+    return size;
+}
+#endif
+
+#if !defined(LFS_READONLY) && defined(LFS_WEAR)
+// find the least worn free block in the range [off, size) of a bitmap of
+// in-use blocks starting at block start, off must be free, ties go to the
+// earliest block
+static lfs_block_t lfs_alloc_findcold(lfs_t *lfs, const uint8_t *buffer,
+        lfs_block_t start, lfs_block_t off, lfs_block_t size) {
+    lfs_block_t cold = off;
+    uint8_t coldwear = lfs->wear[(start + off) % lfs->block_count];
+    while (coldwear > 0) {
+        off = lfs_alloc_findbit(buffer, off+1, size, false);
+        if (off >= size) {
+            break;
+        }
+
+        uint8_t wear = lfs->wear[(start + off) % lfs->block_count];
+        if (wear < coldwear) {
+            cold = off;
+            coldwear = wear;
+        }
+    }
+
+    return cold;
+}
+#endif
+
 #ifndef LFS_READONLY
 static int lfs_alloc_lookahead(void *p, lfs_block_t block) {
     lfs_t *lfs = (lfs_t*)p;
     lfs_block_t off = ((block - lfs->lookahead.start)
             + lfs->block_count) % lfs->block_count;
 
-    if (off < lfs->lookahead.size) {
-        lfs->lookahead.buffer[off / 8] |= 1U << (off % 8);
+    if (off < lfs->lookahead.size) {
+        lfs->lookahead.buffer[off / 8] |= 1U << (off % 8);
+    }
+
+    #ifdef LFS_SUMMARY
+    // record the block's group in our summary, ignoring invalid blocks,
+    // these may come from corrupted skip-lists
+    if (lfs->cfg->summary_size && block < lfs->block_count) {
+        lfs_block_t group = block / lfs->summary.group;
+        lfs->summary.buffer[group / 8] |= 1U << (group % 8);
+    }
+    #endif
+
+    return 0;
+}
+#endif
+
+#if !defined(LFS_READONLY) && defined(LFS_SUMMARY)
+// try to fill the lookahead buffer from our summary, returns false if we
+// need to traverse the filesystem
+static bool lfs_alloc_summary(lfs_t *lfs) {
+    // our summary is only valid until we wrap around the disk, after that
+    // it's missing any blocks we've allocated since
+    lfs_block_t size = lfs_min(lfs->lookahead.size, lfs->summary.remaining);
+    for (lfs_block_t off = 0; off < size; off++) {
+        lfs_block_t block = (lfs->lookahead.start + off) % lfs->block_count;
+        lfs_block_t group = block / lfs->summary.group;
+        if (lfs->summary.buffer[group / 8] & (1U << (group % 8))) {
+            // if groups contain more than one block, we can't tell which
+            // blocks in this group are free, stop here
+            if (lfs->summary.group > 1) {
+                size = off;
+                break;
+            }
+
+            lfs->lookahead.buffer[off / 8] |= 1U << (off % 8);
+        }
     }
 
-    return 0;
+    if (size == 0) {
+        return false;
+    }
+
+    lfs->lookahead.size = size;
+    return true;
+}
+#endif
+
+#if !defined(LFS_READONLY) && defined(LFS_RESERVE)
+// mark blocks reserved with lfs_file_reserve as in-use after rebuilding
+// our view of free blocks
+static void lfs_alloc_markreserved(lfs_t *lfs,
+        int (*cb)(void *data, lfs_block_t block)) {
+    for (lfs_file_t *f = (lfs_file_t*)lfs->mlist; f; f = f->next) {
+        if (f->type == LFS_TYPE_REG && f->extent.reserved) {
+            for (lfs_block_t i = 0; i < f->extent.count; i++) {
+                cb(lfs, f->extent.block + i);
+            }
+        }
+    }
 }
 #endif
 
@@ -630,52 +1433,276 @@ static int lfs_alloc_scan(lfs_t *lfs) {
     //
     // note we limit the lookahead buffer to at most the amount of blocks
     // checkpointed, this prevents the math in lfs_alloc from underflowing
+    lfs_alloc_dropextents(lfs);
     lfs->lookahead.start = (lfs->lookahead.start + lfs->lookahead.next) 
             % lfs->block_count;
+    #ifdef LFS_SUMMARY
+    lfs->summary.remaining -= lfs_min(
+            lfs->lookahead.next,
+            lfs->summary.remaining);
+    #endif
     lfs->lookahead.next = 0;
     lfs->lookahead.size = lfs_min(
             8*lfs->cfg->lookahead_size,
             lfs->lookahead.ckpoint);
+    memset(lfs->lookahead.buffer, 0, lfs->cfg->lookahead_size);
+
+    #ifdef LFS_SUMMARY
+    // find mask of free blocks from our summary if we can
+    if (lfs_alloc_summary(lfs)) {
+        #ifdef LFS_RESERVE
+        lfs_alloc_markreserved(lfs, lfs_alloc_lookahead);
+        #endif
+        return 0;
+    }
+
+    // otherwise find mask of free blocks from tree, recording a new summary
+    // of the whole disk as we go
+    if (lfs->cfg->summary_size) {
+        memset(lfs->summary.buffer, 0, lfs->cfg->summary_size);
+        lfs->summary.group = lfs_max(1,
+                (lfs->block_count + 8*lfs->cfg->summary_size-1)
+                    / (8*lfs->cfg->summary_size));
+    }
+    #endif
 
     // find mask of free blocks from tree
-    memset(lfs->lookahead.buffer, 0, lfs->cfg->lookahead_size);
     int err = lfs_fs_traverse_(lfs, lfs_alloc_lookahead, lfs, true);
     if (err) {
         lfs_alloc_drop(lfs);
         return err;
     }
 
+    #ifdef LFS_SUMMARY
+    if (lfs->cfg->summary_size) {
+        lfs->summary.remaining = lfs->block_count;
+    }
+    #endif
+
+    #ifdef LFS_RESERVE
+    lfs_alloc_markreserved(lfs, lfs_alloc_lookahead);
+    #endif
+    return 0;
+}
+#endif
+
+#if !defined(LFS_READONLY) && defined(LFS_BITMAP)
+static int lfs_alloc_bitmap(void *p, lfs_block_t block) {
+    lfs_t *lfs = (lfs_t*)p;
+    // ignore invalid blocks, these may come from corrupted skip-lists
+    if (block < lfs->block_count) {
+        lfs->bitmap.buffer[block / 8] |= 1U << (block % 8);
+    }
+
+    return 0;
+}
+#endif
+
+#if !defined(LFS_READONLY) && defined(LFS_BITMAP)
+static int lfs_alloc_bitmapscan(lfs_t *lfs) {
+    LFS_ASSERT(8*lfs->cfg->bitmap_size >= lfs->block_count);
+
+    // find mask of free blocks from tree
+    lfs_alloc_dropextents(lfs);
+    memset(lfs->bitmap.buffer, 0, lfs->cfg->bitmap_size);
+    int err = lfs_fs_traverse_(lfs, lfs_alloc_bitmap, lfs, true);
+    if (err) {
+        lfs_alloc_drop(lfs);
+        return err;
+    }
+
+    // blocks allocated since the last checkpoint may not be in the tree
+    // yet, but they must have been found after the checkpoint's cursor, so
+    // keep everything we've looked at since then marked as in-use
+    for (lfs_block_t i = 0; i < lfs->block_count - lfs->lookahead.ckpoint;
+            i++) {
+        lfs_alloc_bitmap(lfs, (lfs->bitmap.ckpoint + i) % lfs->block_count);
+    }
+
+    #ifdef LFS_RESERVE
+    lfs_alloc_markreserved(lfs, lfs_alloc_bitmap);
+    #endif
+
+    lfs->bitmap.size = lfs->block_count;
+    lfs->bitmap.free = lfs->block_count;
+    for (lfs_size_t i = 0; i < (lfs->block_count+7)/8; i++) {
+        lfs->bitmap.free -= lfs_popc(lfs->bitmap.buffer[i]);
+    }
+
+    return 0;
+}
+#endif
+
+#if !defined(LFS_READONLY) && defined(LFS_BITMAP)
+static void lfs_alloc_unmark(lfs_t *lfs, lfs_block_t block) {
+    if (lfs->bitmap.size > 0 && block < lfs->bitmap.size
+            && (lfs->bitmap.buffer[block / 8] & (1U << (block % 8)))) {
+        lfs->bitmap.buffer[block / 8] &= ~(1U << (block % 8));
+        lfs->bitmap.free += 1;
+    }
+}
+#endif
+
+// return a block to the bitmap and queue it to be trimmed, this is only
+// safe once the last reference to the block has been committed and no open
+// file can still reference it
+#ifndef LFS_READONLY
+static void lfs_alloc_free(lfs_t *lfs, lfs_block_t block) {
+    #ifdef LFS_BITMAP
+    lfs_alloc_unmark(lfs, block);
+    #endif
+    lfs_alloc_count(lfs, 1, false);
+
+    #ifdef LFS_TRIM
+    // if we run out of room, the oldest block just goes untrimmed
+    if (lfs->cfg->trim_count > 0 && block < lfs->block_count) {
+        if (lfs->trim.count == lfs->cfg->trim_count) {
+            memmove(&lfs->trim.blocks[0], &lfs->trim.blocks[1],
+                    (lfs->cfg->trim_count-1)*sizeof(lfs_block_t));
+            lfs->trim.count -= 1;
+        }
+
+        lfs->trim.blocks[lfs->trim.count] = block;
+        lfs->trim.count += 1;
+    }
+    #else
+    (void)block;
+    #endif
+}
+#endif
+
+#if !defined(LFS_READONLY) \
+        && (defined(LFS_BITMAP) || defined(LFS_TRIM) || defined(LFS_USEDCOUNT))
+// do we need to know exactly which blocks are freed, and not just how many?
+static bool lfs_alloc_tracksfree(lfs_t *lfs) {
+    #ifdef LFS_BITMAP
+    if (lfs->bitmap.size > 0) {
+        return true;
+    }
+    #endif
+    #ifdef LFS_TRIM
+    if (lfs->cfg->trim_count > 0) {
+        return true;
+    }
+    #endif
+    (void)lfs;
+    return false;
+}
+#endif
+
+#if !defined(LFS_READONLY) && defined(LFS_BITMAP)
+static int lfs_alloc_frombitmap(lfs_t *lfs, lfs_block_t *block) {
+    // build our bitmap on first use, or if the filesystem has grown
+    if (lfs->bitmap.size != lfs->block_count) {
+        int err = lfs_alloc_bitmapscan(lfs);
+        if (err) {
+            return err;
+        }
+    }
+
+    if (lfs->bitmap.free == 0) {
+        // Our bitmap only leaks blocks, never loses them, so if it's out of
+        // free blocks we can try to reclaim any leaked blocks with a full
+        // scan. This is only possible if we know which blocks are
+        // in-flight, see lfs_alloc.
+        if (lfs->lookahead.ckpoint == 0) {
+            LFS_ERROR("No more free space 0x%"PRIx32, lfs->bitmap.next);
+            return LFS_ERR_NOSPC;
+        }
+
+        int err = lfs_alloc_bitmapscan(lfs);
+        if (err) {
+            return err;
+        }
+
+        if (lfs->bitmap.free == 0) {
+            LFS_ERROR("No more free space 0x%"PRIx32, lfs->bitmap.next);
+            return LFS_ERR_NOSPC;
+        }
+    }
+
+    // find the next free block, we rotate through the disk for wear
+    // leveling, the same as the lookahead buffer
+    lfs_block_t next = lfs_alloc_findbit(lfs->bitmap.buffer,
+            lfs->bitmap.next, lfs->block_count, false);
+    if (next == lfs->block_count) {
+        next = lfs_alloc_findbit(lfs->bitmap.buffer,
+                0, lfs->bitmap.next, false);
+        // we know there is at least one free block
+        LFS_ASSERT(next < lfs->bitmap.next);
+    }
+
+    #ifdef LFS_WEAR
+    // prefer the least worn free block we can find within the next
+    // lookahead window, this just moves our cursor further
+    if (lfs->cfg->wear_size) {
+        next = lfs_alloc_findcold(lfs, lfs->bitmap.buffer, 0, next,
+                lfs_min(next + 8*lfs->cfg->lookahead_size,
+                    lfs->block_count));
+    }
+    #endif
+
+    lfs_block_t scanned = ((next - lfs->bitmap.next) + lfs->block_count)
+            % lfs->block_count + 1;
+    lfs->lookahead.ckpoint -= lfs_min(scanned, lfs->lookahead.ckpoint);
+    lfs->bitmap.next = (next + 1) % lfs->block_count;
+
+    // found a free block
+    lfs_alloc_bitmap(lfs, next);
+    lfs->bitmap.free -= 1;
+    lfs_alloc_count(lfs, 1, true);
+    *block = next;
     return 0;
 }
 #endif
 
 #ifndef LFS_READONLY
 static int lfs_alloc(lfs_t *lfs, lfs_block_t *block) {
+    #ifdef LFS_BITMAP
+    if (lfs->cfg->bitmap_size) {
+        return lfs_alloc_frombitmap(lfs, block);
+    }
+    #endif
+
     while (true) {
         // scan our lookahead buffer for free blocks
-        while (lfs->lookahead.next < lfs->lookahead.size) {
-            if (!(lfs->lookahead.buffer[lfs->lookahead.next / 8]
-                    & (1U << (lfs->lookahead.next % 8)))) {
-                // found a free block
-                *block = (lfs->lookahead.start + lfs->lookahead.next)
-                        % lfs->block_count;
-
-                // eagerly find next free block to maximize how many blocks
-                // lfs_alloc_ckpoint makes available for scanning
-                while (true) {
-                    lfs->lookahead.next += 1;
-                    lfs->lookahead.ckpoint -= 1;
-
-                    if (lfs->lookahead.next >= lfs->lookahead.size
-                            || !(lfs->lookahead.buffer[lfs->lookahead.next / 8]
-                                & (1U << (lfs->lookahead.next % 8)))) {
-                        return 0;
-                    }
+        lfs_block_t next = lfs_alloc_findbit(lfs->lookahead.buffer,
+                lfs->lookahead.next, lfs->lookahead.size, false);
+        lfs->lookahead.ckpoint -= next - lfs->lookahead.next;
+        lfs->lookahead.next = next;
+
+        if (lfs->lookahead.next < lfs->lookahead.size) {
+            #ifdef LFS_WEAR
+            // prefer the least worn free block in our lookahead buffer, if
+            // it's not the next block we mark it as in-use so we skip it
+            // later
+            if (lfs->cfg->wear_size) {
+                lfs_block_t off = lfs_alloc_findcold(lfs,
+                        lfs->lookahead.buffer, lfs->lookahead.start,
+                        lfs->lookahead.next, lfs->lookahead.size);
+                if (off != lfs->lookahead.next) {
+                    *block = (lfs->lookahead.start + off) % lfs->block_count;
+                    // our summary must see this, we won't skip it when we
+                    // move our lookahead buffer
+                    lfs_alloc_lookahead(lfs, *block);
+                    lfs_alloc_count(lfs, 1, true);
+                    return 0;
                 }
             }
+            #endif
+
+            // found a free block
+            lfs_alloc_count(lfs, 1, true);
+            *block = (lfs->lookahead.start + lfs->lookahead.next)
+                    % lfs->block_count;
 
-            lfs->lookahead.next += 1;
-            lfs->lookahead.ckpoint -= 1;
+            // eagerly find next free block to maximize how many blocks
+            // lfs_alloc_ckpoint makes available for scanning
+            next = lfs_alloc_findbit(lfs->lookahead.buffer,
+                    lfs->lookahead.next+1, lfs->lookahead.size, false);
+            lfs->lookahead.ckpoint -= next - lfs->lookahead.next;
+            lfs->lookahead.next = next;
+            return 0;
         }
 
         // In order to keep our block allocator from spinning forever when our
@@ -702,6 +1729,261 @@ static int lfs_alloc(lfs_t *lfs, lfs_block_t *block) {
 }
 #endif
 
+#if !defined(LFS_READONLY) && defined(LFS_EXTENTS)
+// check if a block is known to be free and can be allocated out of order
+static bool lfs_alloc_isfree(lfs_t *lfs, lfs_block_t block) {
+    #ifdef LFS_BITMAP
+    if (lfs->cfg->bitmap_size) {
+        return lfs->bitmap.size == lfs->block_count
+                && !(lfs->bitmap.buffer[block / 8] & (1U << (block % 8)));
+    }
+    #endif
+
+    // only blocks the lookahead buffer hasn't passed yet are safe
+    lfs_block_t off = ((block - lfs->lookahead.start)
+            + lfs->block_count) % lfs->block_count;
+    return off >= lfs->lookahead.next
+            && off < lfs->lookahead.size
+            && !(lfs->lookahead.buffer[off / 8] & (1U << (off % 8)));
+}
+#endif
+
+#if !defined(LFS_READONLY) && defined(LFS_EXTENTS)
+// mark a free block as in-use, our allocator will skip it from now on
+static void lfs_alloc_take(lfs_t *lfs, lfs_block_t block) {
+    lfs_alloc_count(lfs, 1, true);
+    #ifdef LFS_BITMAP
+    if (lfs->cfg->bitmap_size) {
+        lfs_alloc_bitmap(lfs, block);
+        lfs->bitmap.free -= 1;
+        return;
+    }
+    #endif
+
+    // this also records the block in our summary, blocks taken out of
+    // order may be after where our next lookahead buffer starts
+    lfs_alloc_lookahead(lfs, block);
+}
+#endif
+
+#if !defined(LFS_READONLY) && defined(LFS_EXTENTS)
+// return any blocks reserved for an extent we no longer need
+static void lfs_alloc_release(lfs_t *lfs, struct lfs_extent *extent) {
+    for (lfs_block_t i = 0; i < extent->count; i++) {
+        lfs_block_t block = extent->block + i;
+        #ifdef LFS_BITMAP
+        if (lfs->cfg->bitmap_size) {
+            lfs_alloc_unmark(lfs, block);
+            continue;
+        }
+        #endif
+
+        // reserved extents may have outlived our lookahead window
+        lfs_block_t off = ((block - lfs->lookahead.start)
+                + lfs->block_count) % lfs->block_count;
+        if (off < lfs->lookahead.size) {
+            lfs->lookahead.buffer[off / 8] &= ~(1U << (off % 8));
+        }
+    }
+
+    lfs_alloc_count(lfs, extent->count, false);
+    extent->count = 0;
+    extent->reserved = false;
+}
+#endif
+
+#if !defined(LFS_READONLY) && defined(LFS_EXTENTS)
+// find the first run of count free blocks we can allocate out of order,
+// returns LFS_BLOCK_NULL if there is none
+static lfs_block_t lfs_alloc_findrun(lfs_t *lfs, lfs_size_t count) {
+    // search in the same order we allocate in
+    const uint8_t *buffer = lfs->lookahead.buffer;
+    lfs_block_t start = lfs->lookahead.start;
+    lfs_block_t ranges[2][2];
+    ranges[0][0] = lfs->lookahead.next;
+    ranges[0][1] = lfs->lookahead.size;
+    ranges[1][0] = 0;
+    ranges[1][1] = 0;
+    #ifdef LFS_BITMAP
+    if (lfs->cfg->bitmap_size) {
+        if (lfs->bitmap.size != lfs->block_count) {
+            return LFS_BLOCK_NULL;
+        }
+
+        buffer = lfs->bitmap.buffer;
+        start = 0;
+        ranges[0][0] = lfs->bitmap.next;
+        ranges[0][1] = lfs->block_count;
+        ranges[1][1] = lfs->bitmap.next;
+    }
+    #endif
+
+    for (int r = 0; r < 2; r++) {
+        lfs_block_t off = ranges[r][0];
+        lfs_block_t size = ranges[r][1];
+        while (off < size) {
+            off = lfs_alloc_findbit(buffer, off, size, false);
+            lfs_block_t end = lfs_alloc_findbit(buffer,
+                    off, lfs_min(off+count, size), true);
+            if (end - off == count) {
+                return (start + off) % lfs->block_count;
+            }
+
+            off = end;
+        }
+    }
+
+    return LFS_BLOCK_NULL;
+}
+#endif
+
+#if !defined(LFS_READONLY) && defined(LFS_PREERASE)
+// erase free blocks ahead of time, in the order our allocator will hand
+// them out, until we have preerase_count erased blocks
+//
+// erased blocks are only tracked in RAM, a block stays erased as long as
+// it's free, and every allocated block is erased before it's programmed,
+// so lfs_bd_erase can forget a pre-erased block as soon as it's allocated
+static int lfs_alloc_preerase(lfs_t *lfs) {
+    const uint8_t *buffer = lfs->lookahead.buffer;
+    lfs_block_t start = lfs->lookahead.start;
+    lfs_block_t ranges[2][2];
+    ranges[0][0] = lfs->lookahead.next;
+    ranges[0][1] = lfs->lookahead.size;
+    ranges[1][0] = 0;
+    ranges[1][1] = 0;
+    #ifdef LFS_BITMAP
+    if (lfs->cfg->bitmap_size) {
+        if (lfs->bitmap.size != lfs->block_count) {
+            return 0;
+        }
+
+        buffer = lfs->bitmap.buffer;
+        start = 0;
+        ranges[0][0] = lfs->bitmap.next;
+        ranges[0][1] = lfs->block_count;
+        ranges[1][1] = lfs->bitmap.next;
+    }
+    #endif
+
+    for (int r = 0; r < 2; r++) {
+        lfs_block_t off = ranges[r][0];
+        lfs_block_t size = ranges[r][1];
+        while (lfs->preerase.count < lfs->cfg->preerase_count) {
+            off = lfs_alloc_findbit(buffer, off, size, false);
+            if (off >= size) {
+                break;
+            }
+
+            lfs_block_t block = (start + off) % lfs->block_count;
+            off += 1;
+
+            // already erased?
+            bool erased = false;
+            for (lfs_size_t i = 0; i < lfs->preerase.count; i++) {
+                if (lfs->preerase.blocks[i] == block) {
+                    erased = true;
+                    break;
+                }
+            }
+
+            if (erased) {
+                continue;
+            }
+
+            int err = lfs_bd_erase(lfs, block);
+            if (err) {
+                // leave bad blocks to be found when they are allocated
+                if (err == LFS_ERR_CORRUPT) {
+                    continue;
+                }
+                return err;
+            }
+
+            lfs->preerase.blocks[lfs->preerase.count] = block;
+            lfs->preerase.count += 1;
+        }
+    }
+
+    return 0;
+}
+#endif
+
+#if !defined(LFS_READONLY) && defined(LFS_EXTENTS)
+// allocate a block for a file's skip-list, following the file's previous
+// block, prev, if we can
+//
+// to keep files written sequentially physically contiguous, each new
+// extent reserves up to extent_size blocks for its file, these are handed
+// out as the file grows and released if the file moves elsewhere
+//
+// blocks reserved with lfs_file_reserve are always handed out first, and
+// are already erased
+static int lfs_alloc_extent(lfs_t *lfs, struct lfs_extent *extent,
+        lfs_block_t prev, lfs_block_t *block, bool *erased) {
+    *erased = false;
+    #ifdef LFS_RESERVE
+    if (extent->reserved) {
+        *block = extent->block;
+        *erased = true;
+        extent->block += 1;
+        extent->count -= 1;
+        extent->reserved = (extent->count > 0);
+        return 0;
+    }
+    #endif
+
+    if (lfs->cfg->extent_size == 0) {
+        return lfs_alloc(lfs, block);
+    }
+
+    // continue our extent?
+    if (extent->count > 0) {
+        if (prev != LFS_BLOCK_NULL && extent->block == prev+1) {
+            *block = extent->block;
+            extent->block += 1;
+            extent->count -= 1;
+            return 0;
+        }
+
+        lfs_alloc_release(lfs, extent);
+    }
+
+    // start a new extent, preferably right after prev, otherwise at the
+    // first run of extent_size free blocks, otherwise wherever our
+    // allocator finds a free block
+    lfs_block_t nblock;
+    if (prev != LFS_BLOCK_NULL && prev+1 < lfs->block_count
+            && lfs_alloc_isfree(lfs, prev+1)) {
+        nblock = prev+1;
+    } else {
+        nblock = lfs_alloc_findrun(lfs, lfs->cfg->extent_size);
+    }
+
+    if (nblock != LFS_BLOCK_NULL) {
+        lfs_alloc_take(lfs, nblock);
+    } else {
+        int err = lfs_alloc(lfs, &nblock);
+        if (err) {
+            return err;
+        }
+    }
+
+    // reserve any free blocks that follow
+    extent->block = nblock+1;
+    extent->count = 0;
+    while (extent->count < lfs->cfg->extent_size-1
+            && extent->block+extent->count < lfs->block_count
+            && lfs_alloc_isfree(lfs, extent->block+extent->count)) {
+        lfs_alloc_take(lfs, extent->block+extent->count);
+        extent->count += 1;
+    }
+
+    *block = nblock;
+    return 0;
+}
+#endif
+
 /// Metadata pair and directory operations ///
 static lfs_stag_t lfs_dir_getslice(lfs_t *lfs, const lfs_mdir_t *dir,
         lfs_tag_t gmask, lfs_tag_t gtag,
@@ -1220,6 +2502,19 @@ static lfs_stag_t lfs_dir_fetchmatch(lfs_t *lfs,
                 continue;
             }
 
+            // if our fetcher wants to look at this entry, make sure the
+            // whole entry ends up in our cache when we crc it, otherwise
+            // matching it would read the start of the entry again, and
+            // evict the window the next tag lives in
+            if ((fmask & tag) == (fmask & ftag)
+                    && lfs->rcache.block == dir->pair[0]
+                    && off + lfs_tag_dsize(tag)
+                        > lfs->rcache.off + lfs->rcache.size
+                    && lfs_tag_dsize(tag) + lfs->cfg->read_size
+                        <= lfs->cfg->cache_size) {
+                lfs_cache_drop(lfs, &lfs->rcache);
+            }
+
             // crc the entry first, hopefully leaving it in the cache
             err = lfs_bd_crc(lfs,
                     NULL, &lfs->rcache, lfs->cfg->block_size,
@@ -1373,10 +2668,35 @@ static lfs_stag_t lfs_dir_fetchmatch(lfs_t *lfs,
 
 static int lfs_dir_fetch(lfs_t *lfs,
         lfs_mdir_t *dir, const lfs_block_t pair[2]) {
+    #ifdef LFS_MDIRCACHE
+    // have we fetched this pair before? any prog or erase to the pair
+    // drops it from our cache, so it still matches the disk
+    for (lfs_size_t i = 0; i < lfs->cfg->mdir_cache_count; i++) {
+        if (lfs_pair_issync(lfs->mdirs[i].pair, pair)) {
+            *dir = lfs->mdirs[i];
+            return 0;
+        }
+    }
+    #endif
+
     // note, mask=-1, tag=-1 can never match a tag since this
     // pattern has the invalid bit set
-    return (int)lfs_dir_fetchmatch(lfs, dir, pair,
+    int err = (int)lfs_dir_fetchmatch(lfs, dir, pair,
             (lfs_tag_t)-1, (lfs_tag_t)-1, NULL, NULL, NULL);
+    if (err) {
+        return err;
+    }
+
+    #ifdef LFS_MDIRCACHE
+    // remember what we found, entries are replaced in the order they
+    // were added
+    if (lfs->cfg->mdir_cache_count > 0) {
+        lfs->mdirs[lfs->mdir_next] = *dir;
+        lfs->mdir_next = (lfs->mdir_next + 1) % lfs->cfg->mdir_cache_count;
+    }
+    #endif
+
+    return 0;
 }
 
 static int lfs_dir_getgstate(lfs_t *lfs, const lfs_mdir_t *dir,
@@ -1431,6 +2751,65 @@ static int lfs_dir_getinfo(lfs_t *lfs, lfs_mdir_t *dir,
     return 0;
 }
 
+#ifdef LFS_LOOKUPCACHE
+// the lookup cache maps a name in a directory, identified by the pair at
+// the head of the directory, to the mdir and tag the name was found at
+static struct lfs_lookup *lfs_lookup_find(lfs_t *lfs,
+        const lfs_block_t parent[2], const char *name, lfs_size_t namelen,
+        uint32_t hash) {
+    for (lfs_size_t i = 0; i < lfs->cfg->lookup_count; i++) {
+        struct lfs_lookup *l = &lfs->lookups[i];
+        if (l->hash == hash
+                && lfs_tag_size(l->tag) == namelen
+                && lfs_pair_cmp(l->parent, parent) == 0
+                && memcmp(l->name, name, namelen) == 0) {
+            return l;
+        }
+    }
+
+    return NULL;
+}
+
+static void lfs_lookup_insert(lfs_t *lfs, const lfs_block_t parent[2],
+        const char *name, uint32_t hash, lfs_tag_t tag,
+        const lfs_mdir_t *dir, const lfs_block_t child[2]) {
+    // entries are replaced in the order they were added
+    struct lfs_lookup *l = &lfs->lookups[lfs->lookup_next];
+    lfs->lookup_next = (lfs->lookup_next + 1) % lfs->cfg->lookup_count;
+
+    l->parent[0] = parent[0];
+    l->parent[1] = parent[1];
+    l->pair[0] = dir->pair[0];
+    l->pair[1] = dir->pair[1];
+    l->child[0] = child[0];
+    l->child[1] = child[1];
+    l->tag = tag;
+    l->hash = hash;
+    memcpy(l->name, name, lfs_tag_size(tag));
+}
+#endif
+
+#if !defined(LFS_READONLY) && defined(LFS_LOOKUPCACHE)
+// forget any lookups that depend on a metadata pair, this needs to happen
+// whenever the pair is committed to, since commits may move, renumber, or
+// remove entries, and relocate the pair itself
+static void lfs_lookup_drop(lfs_t *lfs, const lfs_block_t pair[2]) {
+    for (lfs_size_t i = 0; i < lfs->cfg->lookup_count; i++) {
+        struct lfs_lookup *l = &lfs->lookups[i];
+        if (lfs_pair_cmp(l->parent, pair) == 0
+                || lfs_pair_cmp(l->pair, pair) == 0
+                || lfs_pair_cmp(l->child, pair) == 0) {
+            l->parent[0] = LFS_BLOCK_NULL;
+            l->parent[1] = LFS_BLOCK_NULL;
+            l->pair[0] = LFS_BLOCK_NULL;
+            l->pair[1] = LFS_BLOCK_NULL;
+            l->child[0] = LFS_BLOCK_NULL;
+            l->child[1] = LFS_BLOCK_NULL;
+        }
+    }
+}
+#endif
+
 struct lfs_dir_find_match {
     lfs_t *lfs;
     const void *name;
@@ -1473,6 +2852,13 @@ static lfs_stag_t lfs_dir_find(lfs_t *lfs, lfs_mdir_t *dir,
     lfs_stag_t tag = LFS_MKTAG(LFS_TYPE_DIR, 0x3ff, 0);
     dir->tail[0] = lfs->root[0];
     dir->tail[1] = lfs->root[1];
+    lfs_block_t child[2] = {lfs->root[0], lfs->root[1]};
+
+    #ifdef LFS_LOOKUPCACHE
+    // if we skip a directory thanks to our lookup cache, this is where
+    // its entry lives in case we need to fetch it after all
+    lfs_block_t skipped[2] = {LFS_BLOCK_NULL, LFS_BLOCK_NULL};
+    #endif
 
     while (true) {
 nextname:
@@ -1513,6 +2899,15 @@ nextname:
 
         // found path
         if (name[0] == '\0') {
+            #ifdef LFS_LOOKUPCACHE
+            if (!lfs_pair_isnull(skipped)) {
+                int err = lfs_dir_fetch(lfs, dir, skipped);
+                if (err) {
+                    return err;
+                }
+            }
+            #endif
+
             return tag;
         }
 
@@ -1524,23 +2919,58 @@ nextname:
             return LFS_ERR_NOTDIR;
         }
 
-        // grab the entry data
-        if (lfs_tag_id(tag) != 0x3ff) {
-            lfs_stag_t res = lfs_dir_get(lfs, dir, LFS_MKTAG(0x700, 0x3ff, 0),
-                    LFS_MKTAG(LFS_TYPE_STRUCT, lfs_tag_id(tag), 8), dir->tail);
-            if (res < 0) {
-                return res;
+        // are we last name?
+        bool last = (strchr(name, '/') == NULL);
+        dir->tail[0] = child[0];
+        dir->tail[1] = child[1];
+
+        #ifdef LFS_LOOKUPCACHE
+        // check our lookup cache first, but not while a move is pending,
+        // the moved entry may be found in either mdir
+        bool cached = lfs->cfg->lookup_count > 0
+                && !lfs_gstate_hasmove(&lfs->gdisk);
+        uint32_t hash = 0;
+        if (cached) {
+            hash = lfs_crc(0xffffffff, name, namelen);
+            const struct lfs_lookup *l = lfs_lookup_find(lfs,
+                    child, name, namelen, hash);
+            if (l) {
+                tag = l->tag;
+                child[0] = l->child[0];
+                child[1] = l->child[1];
+                if (last) {
+                    int err = lfs_dir_fetch(lfs, dir, l->pair);
+                    if (err) {
+                        return err;
+                    }
+
+                    if (id) {
+                        *id = lfs_tag_id(tag);
+                    }
+                    skipped[0] = LFS_BLOCK_NULL;
+                    skipped[1] = LFS_BLOCK_NULL;
+                } else {
+                    skipped[0] = l->pair[0];
+                    skipped[1] = l->pair[1];
+                }
+
+                name += namelen;
+                continue;
             }
-            lfs_pair_fromle32(dir->tail);
         }
+        skipped[0] = LFS_BLOCK_NULL;
+        skipped[1] = LFS_BLOCK_NULL;
+        lfs_block_t parent[2] = {child[0], child[1]};
+        #else
+        bool cached = false;
+        #endif
 
         // find entry matching name
         while (true) {
             tag = lfs_dir_fetchmatch(lfs, dir, dir->tail,
                     LFS_MKTAG(0x780, 0, 0),
                     LFS_MKTAG(LFS_TYPE_NAME, 0, namelen),
-                     // are we last name?
-                    (strchr(name, '/') == NULL) ? id : NULL,
+                    (last) ? id : NULL,
                     lfs_dir_find_match, &(struct lfs_dir_find_match){
                         lfs, name, namelen});
             if (tag < 0) {
@@ -1556,6 +2986,24 @@ nextname:
             }
         }
 
+        // grab the entry data if we need it
+        child[0] = LFS_BLOCK_NULL;
+        child[1] = LFS_BLOCK_NULL;
+        if (lfs_tag_type3(tag) == LFS_TYPE_DIR && (!last || cached)) {
+            lfs_stag_t res = lfs_dir_get(lfs, dir, LFS_MKTAG(0x700, 0x3ff, 0),
+                    LFS_MKTAG(LFS_TYPE_STRUCT, lfs_tag_id(tag), 8), child);
+            if (res < 0) {
+                return res;
+            }
+            lfs_pair_fromle32(child);
+        }
+
+        #ifdef LFS_LOOKUPCACHE
+        if (cached) {
+            lfs_lookup_insert(lfs, parent, name, hash, tag, dir, child);
+        }
+        #endif
+
         // to next name
         name += namelen;
     }
@@ -1844,6 +3292,14 @@ static int lfs_dir_drop(lfs_t *lfs, lfs_mdir_t *dir, lfs_mdir_t *tail) {
         return err;
     }
 
+    #ifdef LFS_GCSTEP
+    // skip our gc cursor past the dropped pair
+    if (lfs_pair_cmp(tail->pair, lfs->gctail) == 0) {
+        lfs->gctail[0] = tail->tail[0];
+        lfs->gctail[1] = tail->tail[1];
+    }
+    #endif
+
     return 0;
 }
 #endif
@@ -2085,6 +3541,11 @@ relocate:
             return err;
         }
 
+        // the old half of our pair is no longer in-use
+        if (!err) {
+            lfs_alloc_count(lfs, 1, false);
+        }
+
         tired = false;
         continue;
     }
@@ -2208,6 +3669,13 @@ static int lfs_dir_relocatingcommit(lfs_t *lfs, lfs_mdir_t *dir,
         lfs_mdir_t *pdir) {
     int state = 0;
 
+    #ifdef LFS_LOOKUPCACHE
+    // any lookups into this pair may be outdated after this
+    if (lfs->cfg->lookup_count > 0) {
+        lfs_lookup_drop(lfs, pair);
+    }
+    #endif
+
     // calculate changes to the directory
     bool hasdelete = false;
     for (int i = 0; i < attrcount; i++) {
@@ -2435,6 +3903,15 @@ static int lfs_dir_orphaningcommit(lfs_t *lfs, lfs_mdir_t *dir,
             return state;
         }
 
+        #ifdef LFS_GCSTEP
+        // skip our gc cursor past the dropped pair
+        if (lfs_pair_cmp(dir->pair, lfs->gctail) == 0) {
+            lfs->gctail[0] = dir->tail[0];
+            lfs->gctail[1] = dir->tail[1];
+        }
+        #endif
+        lfs_alloc_count(lfs, 2, false);
+
         ldir = pdir;
     }
 
@@ -2452,6 +3929,14 @@ static int lfs_dir_orphaningcommit(lfs_t *lfs, lfs_mdir_t *dir,
             lfs->root[1] = ldir.pair[1];
         }
 
+        #ifdef LFS_GCSTEP
+        // update our gc cursor
+        if (lfs_pair_cmp(lpair, lfs->gctail) == 0) {
+            lfs->gctail[0] = ldir.pair[0];
+            lfs->gctail[1] = ldir.pair[1];
+        }
+        #endif
+
         // update internally tracked dirs
         for (struct lfs_mlist *d = lfs->mlist; d; d = d->next) {
             if (lfs_pair_cmp(lpair, d->m.pair) == 0) {
@@ -2853,9 +4338,24 @@ static int lfs_ctz_index(lfs_t *lfs, lfs_off_t *off) {
     return i;
 }
 
+#ifdef LFS_FILEINDEX
+// number of skips needed to get from one block index to another
+static lfs_off_t lfs_ctz_skips(lfs_off_t current, lfs_off_t target) {
+    lfs_off_t skips = 0;
+    while (current > target) {
+        current -= 1 << lfs_min(
+                lfs_npw2(current-target+1) - 1,
+                lfs_ctz(current));
+        skips += 1;
+    }
+
+    return skips;
+}
+#endif
+
 static int lfs_ctz_find(lfs_t *lfs,
         const lfs_cache_t *pcache, lfs_cache_t *rcache,
-        lfs_block_t head, lfs_size_t size,
+        lfs_block_t head, lfs_size_t size, lfs_file_t *file,
         lfs_size_t pos, lfs_block_t *block, lfs_off_t *off) {
     if (size == 0) {
         *block = LFS_BLOCK_NULL;
@@ -2863,9 +4363,35 @@ static int lfs_ctz_find(lfs_t *lfs,
         return 0;
     }
 
-    lfs_off_t current = lfs_ctz_index(lfs, &(lfs_off_t){size-1});
+    lfs_off_t last = lfs_ctz_index(lfs, &(lfs_off_t){size-1});
+    lfs_off_t current = last;
     lfs_off_t target = lfs_ctz_index(lfs, &pos);
 
+    #ifdef LFS_FILEINDEX
+    // start from whichever indexed block needs the fewest skips, note
+    // the skip-list only has long pointers at aligned indices, so the
+    // nearest block isn't always the cheapest
+    struct lfs_index *index = file->index;
+    lfs_size_t count = file->cfg->index_count;
+    if (index) {
+        lfs_off_t skips = lfs_ctz_skips(current, target);
+        for (lfs_size_t i = 0; i < count && skips > 0; i++) {
+            if (index[i].block != LFS_BLOCK_NULL
+                    && index[i].index >= target
+                    && index[i].index <= last) {
+                lfs_off_t skips_ = lfs_ctz_skips(index[i].index, target);
+                if (skips_ < skips) {
+                    skips = skips_;
+                    current = index[i].index;
+                    head = index[i].block;
+                }
+            }
+        }
+    }
+    #else
+    (void)file;
+    #endif
+
     while (current > target) {
         lfs_size_t skip = lfs_min(
                 lfs_npw2(current-target+1) - 1,
@@ -2880,6 +4406,16 @@ static int lfs_ctz_find(lfs_t *lfs,
         }
 
         current -= 1 << skip;
+
+        #ifdef LFS_FILEINDEX
+        if (index) {
+            // remember where we've been, entries are spread evenly over
+            // the file so later searches always start near their target
+            struct lfs_index *entry = &index[current / (last/count + 1)];
+            entry->index = current;
+            entry->block = head;
+        }
+        #endif
     }
 
     *block = head;
@@ -2887,26 +4423,60 @@ static int lfs_ctz_find(lfs_t *lfs,
     return 0;
 }
 
+#ifndef LFS_READONLY
+// forget any indexed blocks at or after pos, these are about to be
+// rewritten
+static void lfs_ctz_dropindex(lfs_t *lfs, lfs_file_t *file, lfs_off_t pos) {
+    #ifdef LFS_FILEINDEX
+    if (!file->index) {
+        return;
+    }
+
+    lfs_off_t first = lfs_ctz_index(lfs, &pos);
+    for (lfs_size_t i = 0; i < file->cfg->index_count; i++) {
+        if (file->index[i].block != LFS_BLOCK_NULL
+                && file->index[i].index >= first) {
+            file->index[i].block = LFS_BLOCK_NULL;
+        }
+    }
+    #else
+    (void)lfs;
+    (void)file;
+    (void)pos;
+    #endif
+}
+#endif
+
 #ifndef LFS_READONLY
 static int lfs_ctz_extend(lfs_t *lfs,
         lfs_cache_t *pcache, lfs_cache_t *rcache,
-        lfs_block_t head, lfs_size_t size,
+        lfs_block_t head, lfs_size_t size, lfs_file_t *file,
         lfs_block_t *block, lfs_off_t *off) {
     while (true) {
-        // go ahead and grab a block
+        // go ahead and grab a block, following our head if we can
         lfs_block_t nblock;
+        bool erased = false;
+        #ifdef LFS_EXTENTS
+        int err = lfs_alloc_extent(lfs, &file->extent,
+                (size == 0) ? LFS_BLOCK_NULL : head,
+                &nblock, &erased);
+        #else
+        (void)file;
         int err = lfs_alloc(lfs, &nblock);
+        #endif
         if (err) {
             return err;
         }
 
         {
-            err = lfs_bd_erase(lfs, nblock);
-            if (err) {
-                if (err == LFS_ERR_CORRUPT) {
-                    goto relocate;
+            if (!erased) {
+                err = lfs_bd_erase(lfs, nblock);
+                if (err) {
+                    if (err == LFS_ERR_CORRUPT) {
+                        goto relocate;
+                    }
+                    return err;
                 }
-                return err;
             }
 
             if (size == 0) {
@@ -2980,6 +4550,7 @@ static int lfs_ctz_extend(lfs_t *lfs,
 
 relocate:
         LFS_DEBUG("Bad block at 0x%"PRIx32, nblock);
+        lfs_alloc_count(lfs, 1, false);
 
         // just clear cache and try a new block
         lfs_cache_drop(lfs, pcache);
@@ -3030,6 +4601,137 @@ static int lfs_ctz_traverse(lfs_t *lfs,
     }
 }
 
+#ifndef LFS_READONLY
+// find the ctz skip-list of a file that is about to be replaced, if its
+// blocks can be returned to the free-block bitmap or trimmed afterwards
+//
+// other open files of the same id may still reference these blocks, in
+// which case we leave them for the next scan
+static int lfs_ctz_getfree(lfs_t *lfs, struct lfs_mlist *node,
+        lfs_mdir_t *dir, uint16_t id, struct lfs_ctz *ctz) {
+    ctz->head = LFS_BLOCK_NULL;
+    ctz->size = 0;
+    #if defined(LFS_BITMAP) || defined(LFS_TRIM) || defined(LFS_USEDCOUNT)
+    #ifdef LFS_USEDCOUNT
+    bool counting = (lfs->used != LFS_BLOCK_NULL);
+    #else
+    bool counting = false;
+    #endif
+    if ((!lfs_alloc_tracksfree(lfs) && !counting)
+            || lfs_mlist_isshared(lfs, node, dir->pair, id)) {
+        return 0;
+    }
+
+    struct lfs_ctz ctz_;
+    lfs_stag_t tag = lfs_dir_get(lfs, dir, LFS_MKTAG(0x700, 0x3ff, 0),
+            LFS_MKTAG(LFS_TYPE_STRUCT, id, sizeof(ctz_)), &ctz_);
+    if (tag < 0 && tag != LFS_ERR_NOENT) {
+        return tag;
+    }
+
+    if (tag >= 0 && lfs_tag_type3(tag) == LFS_TYPE_CTZSTRUCT) {
+        lfs_ctz_fromle32(&ctz_);
+        *ctz = ctz_;
+    }
+    #else
+    (void)lfs;
+    (void)node;
+    (void)dir;
+    (void)id;
+    #endif
+
+    return 0;
+}
+#endif
+
+#ifndef LFS_READONLY
+// return the blocks of a replaced ctz skip-list to the free-block bitmap
+// and our count of in-use blocks, skipping any blocks still shared with the
+// skip-list that replaced it
+//
+// blocks are never modified once written, so if both skip-lists contain
+// the same block at the same index, they share every block below it
+static void lfs_ctz_free(lfs_t *lfs,
+        lfs_block_t head, lfs_size_t size,
+        lfs_block_t nhead, lfs_size_t nsize) {
+    #if defined(LFS_BITMAP) || defined(LFS_TRIM) || defined(LFS_USEDCOUNT)
+    if (size == 0) {
+        return;
+    }
+
+    // if nothing needs to know which blocks are free, we only need to know
+    // how many, which is cheap if the skip-lists don't share any blocks,
+    // otherwise we still need to find where they meet
+    if (!lfs_alloc_tracksfree(lfs)) {
+        #ifdef LFS_USEDCOUNT
+        if (lfs->used == LFS_BLOCK_NULL) {
+            return;
+        }
+
+        if (nsize == 0) {
+            lfs_alloc_count(lfs,
+                    lfs_ctz_index(lfs, &(lfs_off_t){size-1}) + 1,
+                    false);
+            return;
+        }
+        #else
+        return;
+        #endif
+    }
+
+    lfs_off_t index = lfs_ctz_index(lfs, &(lfs_off_t){size-1});
+    lfs_off_t nindex = (nsize > 0)
+            ? lfs_ctz_index(lfs, &(lfs_off_t){nsize-1})
+            : 0;
+
+    while (true) {
+        while (nsize > 0 && nindex > index) {
+            int err = lfs_bd_read(lfs,
+                    NULL, &lfs->rcache, sizeof(nhead),
+                    nhead, 0, &nhead, sizeof(nhead));
+            if (err) {
+                // we can't tell what's shared, leave the remaining blocks
+                // for the next scan, and count them again
+                #ifdef LFS_USEDCOUNT
+                lfs->used = LFS_BLOCK_NULL;
+                #endif
+                return;
+            }
+            nhead = lfs_fromle32(nhead);
+            nindex -= 1;
+        }
+
+        if (nsize > 0 && nindex == index && nhead == head) {
+            return;
+        }
+
+        lfs_alloc_free(lfs, head);
+        if (index == 0) {
+            return;
+        }
+
+        int err = lfs_bd_read(lfs,
+                NULL, &lfs->rcache, sizeof(head),
+                head, 0, &head, sizeof(head));
+        if (err) {
+            #ifdef LFS_USEDCOUNT
+            lfs->used = LFS_BLOCK_NULL;
+            #endif
+            return;
+        }
+        head = lfs_fromle32(head);
+        index -= 1;
+    }
+    #else
+    (void)lfs;
+    (void)head;
+    (void)size;
+    (void)nhead;
+    (void)nsize;
+    #endif
+}
+#endif
+
 
 /// Top level file operations ///
 static int lfs_file_opencfg_(lfs_t *lfs, lfs_file_t *file,
@@ -3054,6 +4756,16 @@ static int lfs_file_opencfg_(lfs_t *lfs, lfs_file_t *file,
     file->pos = 0;
     file->off = 0;
     file->cache.buffer = NULL;
+#ifdef LFS_READAHEAD
+    file->ahead.buffer = NULL;
+#endif
+#ifdef LFS_FILEINDEX
+    file->index = NULL;
+#endif
+#ifdef LFS_EXTENTS
+    file->extent.count = 0;
+    file->extent.reserved = false;
+#endif
 
     // allocate entry for file if it doesn't exist
     lfs_stag_t tag = lfs_dir_find(lfs, &file->m, &path, &file->id);
@@ -3164,6 +4876,44 @@ static int lfs_file_opencfg_(lfs_t *lfs, lfs_file_t *file,
     // zero to avoid information leak
     lfs_cache_zero(lfs, &file->cache);
 
+#ifdef LFS_READAHEAD
+    // allocate read-ahead buffer if requested
+    if (file->cfg->readahead_size) {
+        LFS_ASSERT(file->cfg->readahead_size % lfs->cfg->read_size == 0);
+        LFS_ASSERT(lfs->cfg->block_size % file->cfg->readahead_size == 0);
+        if (file->cfg->readahead_buffer) {
+            file->ahead.buffer = file->cfg->readahead_buffer;
+        } else {
+            file->ahead.buffer = lfs_malloc(file->cfg->readahead_size);
+            if (!file->ahead.buffer) {
+                err = LFS_ERR_NOMEM;
+                goto cleanup;
+            }
+        }
+    }
+    lfs_cache_drop(lfs, &file->ahead);
+#endif
+
+#ifdef LFS_FILEINDEX
+    // allocate block index if requested
+    if (file->cfg->index_count) {
+        if (file->cfg->index_buffer) {
+            file->index = file->cfg->index_buffer;
+        } else {
+            file->index = lfs_malloc(
+                    file->cfg->index_count*sizeof(struct lfs_index));
+            if (!file->index) {
+                err = LFS_ERR_NOMEM;
+                goto cleanup;
+            }
+        }
+
+        for (lfs_size_t i = 0; i < file->cfg->index_count; i++) {
+            file->index[i].block = LFS_BLOCK_NULL;
+        }
+    }
+#endif
+
     if (lfs_tag_type3(tag) == LFS_TYPE_INLINESTRUCT) {
         // load inline files
         file->ctz.head = LFS_BLOCK_INLINE;
@@ -3210,6 +4960,11 @@ static int lfs_file_open_(lfs_t *lfs, lfs_file_t *file,
 static int lfs_file_close_(lfs_t *lfs, lfs_file_t *file) {
 #ifndef LFS_READONLY
     int err = lfs_file_sync_(lfs, file);
+
+#ifdef LFS_EXTENTS
+    // release any blocks we reserved but didn't use
+    lfs_alloc_release(lfs, &file->extent);
+#endif
 #else
     int err = 0;
 #endif
@@ -3222,6 +4977,18 @@ static int lfs_file_close_(lfs_t *lfs, lfs_file_t *file) {
         lfs_free(file->cache.buffer);
     }
 
+#ifdef LFS_READAHEAD
+    if (!file->cfg->readahead_buffer) {
+        lfs_free(file->ahead.buffer);
+    }
+#endif
+
+#ifdef LFS_FILEINDEX
+    if (!file->cfg->index_buffer) {
+        lfs_free(file->index);
+    }
+#endif
+
     return err;
 }
 
@@ -3229,19 +4996,33 @@ static int lfs_file_close_(lfs_t *lfs, lfs_file_t *file) {
 #ifndef LFS_READONLY
 static int lfs_file_relocate(lfs_t *lfs, lfs_file_t *file) {
     while (true) {
-        // just relocate what exists into new block
+        // just relocate what exists into new block, using any blocks we
+        // reserved
         lfs_block_t nblock;
-        int err = lfs_alloc(lfs, &nblock);
+        bool erased = false;
+        int err;
+        #ifdef LFS_RESERVE
+        if (file->extent.reserved) {
+            err = lfs_alloc_extent(lfs, &file->extent, LFS_BLOCK_NULL,
+                    &nblock, &erased);
+        } else {
+            err = lfs_alloc(lfs, &nblock);
+        }
+        #else
+        err = lfs_alloc(lfs, &nblock);
+        #endif
         if (err) {
             return err;
         }
 
-        err = lfs_bd_erase(lfs, nblock);
-        if (err) {
-            if (err == LFS_ERR_CORRUPT) {
-                goto relocate;
+        if (!erased) {
+            err = lfs_bd_erase(lfs, nblock);
+            if (err) {
+                if (err == LFS_ERR_CORRUPT) {
+                    goto relocate;
+                }
+                return err;
             }
-            return err;
         }
 
         // either read from dirty cache or disk
@@ -3290,6 +5071,7 @@ static int lfs_file_relocate(lfs_t *lfs, lfs_file_t *file) {
 
 relocate:
         LFS_DEBUG("Bad block at 0x%"PRIx32, nblock);
+        lfs_alloc_count(lfs, 1, false);
 
         // just clear cache and try a new block
         lfs_cache_drop(lfs, &lfs->pcache);
@@ -3316,6 +5098,9 @@ static int lfs_file_flush(lfs_t *lfs, lfs_file_t *file) {
         if (!(file->flags & LFS_F_INLINE)) {
             lfs_cache_drop(lfs, &file->cache);
         }
+#ifdef LFS_READAHEAD
+        lfs_cache_drop(lfs, &file->ahead);
+#endif
         file->flags &= ~LFS_F_READING;
     }
 
@@ -3331,6 +5116,10 @@ static int lfs_file_flush(lfs_t *lfs, lfs_file_t *file) {
                 .flags = LFS_O_RDONLY,
                 .pos = file->pos,
                 .cache = lfs->rcache,
+#ifdef LFS_READAHEAD
+                .ahead = file->ahead,
+#endif
+                .cfg = file->cfg,
             };
             lfs_cache_drop(lfs, &lfs->rcache);
 
@@ -3365,88 +5154,309 @@ static int lfs_file_flush(lfs_t *lfs, lfs_file_t *file) {
                     return err;
                 }
 
-                break;
+                break;
+
+relocate:
+                LFS_DEBUG("Bad block at 0x%"PRIx32, file->block);
+                err = lfs_file_relocate(lfs, file);
+                if (err) {
+                    return err;
+                }
+            }
+        } else {
+            file->pos = lfs_max(file->pos, file->ctz.size);
+        }
+
+        // actual file updates
+        file->ctz.head = file->block;
+        file->ctz.size = file->pos;
+        file->flags &= ~LFS_F_WRITING;
+        file->flags |= LFS_F_DIRTY;
+
+        file->pos = pos;
+    }
+#endif
+
+    return 0;
+}
+
+#ifndef LFS_READONLY
+// build the attributes that update a file's dir entry, ctz is scratch
+// space that must outlive the commit
+static void lfs_file_mkattrs(const lfs_file_t *file,
+        struct lfs_mattr attrs[2], struct lfs_ctz *ctz) {
+    if (file->flags & LFS_F_INLINE) {
+        // inline the whole file
+        attrs[0].tag = LFS_MKTAG(
+                LFS_TYPE_INLINESTRUCT, file->id, file->ctz.size);
+        attrs[0].buffer = file->cache.buffer;
+    } else {
+        // update the ctz reference, copying ctz so alloc will work during
+        // a relocate
+        *ctz = file->ctz;
+        lfs_ctz_tole32(ctz);
+        attrs[0].tag = LFS_MKTAG(
+                LFS_TYPE_CTZSTRUCT, file->id, sizeof(*ctz));
+        attrs[0].buffer = ctz;
+    }
+
+    attrs[1].tag = LFS_MKTAG(
+            LFS_FROM_USERATTRS, file->id, file->cfg->attr_count);
+    attrs[1].buffer = file->cfg->attrs;
+}
+#endif
+
+#ifndef LFS_READONLY
+static int lfs_file_sync_(lfs_t *lfs, lfs_file_t *file) {
+    if (file->flags & LFS_F_ERRED) {
+        // it's not safe to do anything if our file errored
+        return 0;
+    }
+
+    int err = lfs_file_flush(lfs, file);
+    if (err) {
+        file->flags |= LFS_F_ERRED;
+        return err;
+    }
+
+
+    if ((file->flags & LFS_F_DIRTY) &&
+            !lfs_pair_isnull(file->m.pair)) {
+        // before we commit metadata, we need sync the disk to make sure
+        // data writes don't complete after metadata writes
+        if (!(file->flags & LFS_F_INLINE)) {
+            err = lfs_bd_sync(lfs, &lfs->pcache, &lfs->rcache, false);
+            if (err) {
+                return err;
+            }
+        }
+
+        // update dir entry
+        struct lfs_mattr attrs[2];
+        struct lfs_ctz ctz;
+        lfs_file_mkattrs(file, attrs, &ctz);
+
+        // find the skip-list we're replacing
+        struct lfs_ctz octz;
+        err = lfs_ctz_getfree(lfs, (struct lfs_mlist*)file,
+                &file->m, file->id, &octz);
+        if (err) {
+            return err;
+        }
+
+        // commit file data and attributes
+        err = lfs_dir_commit(lfs, &file->m, attrs, 2);
+        if (err) {
+            file->flags |= LFS_F_ERRED;
+            return err;
+        }
+
+        file->flags &= ~LFS_F_DIRTY;
+
+        // return any blocks we no longer reference to the bitmap
+        if (file->flags & LFS_F_INLINE) {
+            lfs_ctz_free(lfs, octz.head, octz.size, LFS_BLOCK_NULL, 0);
+        } else {
+            lfs_ctz_free(lfs, octz.head, octz.size,
+                    file->ctz.head, file->ctz.size);
+        }
+    }
+
+    return 0;
+}
+#endif
+
+#if !defined(LFS_READONLY) && defined(LFS_SYNCV)
+static int lfs_file_syncv_(lfs_t *lfs,
+        lfs_file_t *const *files, lfs_size_t count) {
+    // flush all files first, our metadata commits need to come after
+    // any data writes
+    bool needscommit = false;
+    bool needssync = false;
+    for (lfs_size_t i = 0; i < count; i++) {
+        lfs_file_t *file = files[i];
+        if (file->flags & LFS_F_ERRED) {
+            // it's not safe to do anything if our file errored
+            continue;
+        }
+
+        int err = lfs_file_flush(lfs, file);
+        if (err) {
+            file->flags |= LFS_F_ERRED;
+            return err;
+        }
+
+        if ((file->flags & LFS_F_DIRTY) && !lfs_pair_isnull(file->m.pair)) {
+            needscommit = true;
+            if (!(file->flags & LFS_F_INLINE)) {
+                needssync = true;
+            }
+        }
+    }
+
+    if (!needscommit) {
+        return 0;
+    }
+
+    // before we commit metadata, we need sync the disk to make sure
+    // data writes don't complete after metadata writes
+    if (needssync) {
+        int err = lfs_bd_sync(lfs, &lfs->pcache, &lfs->rcache, false);
+        if (err) {
+            return err;
+        }
+    }
+
+    // commit files that share a metadata pair together, at most
+    // LFS_SYNCV_MAX at a time
+    for (lfs_size_t i = 0; i < count; i++) {
+        lfs_file_t *file = files[i];
+        if ((file->flags & LFS_F_ERRED)
+                || !(file->flags & LFS_F_DIRTY)
+                || lfs_pair_isnull(file->m.pair)) {
+            continue;
+        }
+
+        // collect dirty files in this metadata pair, skipping duplicates
+        lfs_file_t *batch[LFS_SYNCV_MAX];
+        struct lfs_mattr attrs[2*LFS_SYNCV_MAX];
+        struct lfs_ctz ctzs[LFS_SYNCV_MAX];
+        struct lfs_ctz octzs[LFS_SYNCV_MAX];
+        lfs_size_t n = 0;
+        for (lfs_size_t j = i; j < count && n < LFS_SYNCV_MAX; j++) {
+            lfs_file_t *f = files[j];
+            if ((f->flags & LFS_F_ERRED)
+                    || !(f->flags & LFS_F_DIRTY)
+                    || lfs_pair_cmp(f->m.pair, file->m.pair) != 0) {
+                continue;
+            }
+
+            bool dup = false;
+            for (lfs_size_t k = 0; k < n; k++) {
+                if (batch[k] == f) {
+                    dup = true;
+                    break;
+                }
+            }
+            if (dup) {
+                continue;
+            }
+
+            lfs_file_mkattrs(f, &attrs[2*n], &ctzs[n]);
+
+            // find the skip-list we're replacing
+            int err = lfs_ctz_getfree(lfs, (struct lfs_mlist*)f,
+                    &f->m, f->id, &octzs[n]);
+            if (err) {
+                return err;
+            }
+
+            batch[n] = f;
+            n += 1;
+        }
 
-relocate:
-                LFS_DEBUG("Bad block at 0x%"PRIx32, file->block);
-                err = lfs_file_relocate(lfs, file);
-                if (err) {
-                    return err;
-                }
+        // commit file data and attributes in one go
+        int err = lfs_dir_commit(lfs, &file->m, attrs, 2*n);
+
+        // our commit may have moved files to other metadata pairs, so
+        // update exactly the files we committed
+        for (lfs_size_t k = 0; k < n; k++) {
+            if (err) {
+                batch[k]->flags |= LFS_F_ERRED;
+            } else {
+                batch[k]->flags &= ~LFS_F_DIRTY;
             }
-        } else {
-            file->pos = lfs_max(file->pos, file->ctz.size);
+        }
+        if (err) {
+            return err;
         }
 
-        // actual file updates
-        file->ctz.head = file->block;
-        file->ctz.size = file->pos;
-        file->flags &= ~LFS_F_WRITING;
-        file->flags |= LFS_F_DIRTY;
-
-        file->pos = pos;
+        // return any blocks we no longer reference to the bitmap
+        for (lfs_size_t k = 0; k < n; k++) {
+            lfs_file_t *f = batch[k];
+            if (f->flags & LFS_F_INLINE) {
+                lfs_ctz_free(lfs, octzs[k].head, octzs[k].size,
+                        LFS_BLOCK_NULL, 0);
+            } else {
+                lfs_ctz_free(lfs, octzs[k].head, octzs[k].size,
+                        f->ctz.head, f->ctz.size);
+            }
+        }
     }
-#endif
 
     return 0;
 }
+#endif
 
-#ifndef LFS_READONLY
-static int lfs_file_sync_(lfs_t *lfs, lfs_file_t *file) {
-    if (file->flags & LFS_F_ERRED) {
-        // it's not safe to do anything if our file errored
-        return 0;
-    }
+#ifdef LFS_READAHEAD
+static int lfs_file_readahead(lfs_t *lfs, lfs_file_t *file,
+        void *buffer, lfs_size_t size) {
+    uint8_t *data = buffer;
+    lfs_cache_t *ahead = &file->ahead;
+    lfs_off_t off = file->off;
 
-    int err = lfs_file_flush(lfs, file);
-    if (err) {
-        file->flags |= LFS_F_ERRED;
-        return err;
-    }
+    while (size > 0) {
+        lfs_size_t diff = size;
 
+        if (file->block == ahead->block &&
+                off >= ahead->off &&
+                off < ahead->off + ahead->size) {
+            // is already in read-ahead window?
+            diff = lfs_min(diff, ahead->size - (off-ahead->off));
+            memcpy(data, &ahead->buffer[off-ahead->off], diff);
 
-    if ((file->flags & LFS_F_DIRTY) &&
-            !lfs_pair_isnull(file->m.pair)) {
-        // before we commit metadata, we need sync the disk to make sure
-        // data writes don't complete after metadata writes
-        if (!(file->flags & LFS_F_INLINE)) {
-            err = lfs_bd_sync(lfs, &lfs->pcache, &lfs->rcache, false);
-            if (err) {
-                return err;
-            }
+            data += diff;
+            off += diff;
+            size -= diff;
+            continue;
         }
 
-        // update dir entry
-        uint16_t type;
-        const void *buffer;
-        lfs_size_t size;
-        struct lfs_ctz ctz;
-        if (file->flags & LFS_F_INLINE) {
-            // inline the whole file
-            type = LFS_TYPE_INLINESTRUCT;
-            buffer = file->cache.buffer;
-            size = file->ctz.size;
-        } else {
-            // update the ctz reference
-            type = LFS_TYPE_CTZSTRUCT;
-            // copy ctz so alloc will work during a relocate
-            ctz = file->ctz;
-            lfs_ctz_tole32(&ctz);
-            buffer = &ctz;
-            size = sizeof(ctz);
+        if (file->block == file->cache.block &&
+                off >= file->cache.off &&
+                off < file->cache.off + file->cache.size) {
+            // is already in file cache? this is common after lfs_ctz_find
+            diff = lfs_min(diff, file->cache.size - (off-file->cache.off));
+            memcpy(data, &file->cache.buffer[off-file->cache.off], diff);
+
+            data += diff;
+            off += diff;
+            size -= diff;
+            continue;
         }
 
-        // commit file data and attributes
-        err = lfs_dir_commit(lfs, &file->m, LFS_MKATTRS(
-                {LFS_MKTAG(type, file->id, size), buffer},
-                {LFS_MKTAG(LFS_FROM_USERATTRS, file->id,
-                    file->cfg->attr_count), file->cfg->attrs}));
+        // only read ahead if we are continuing a sequential read, either
+        // from the start of the block or where our last read left off, and
+        // if the read isn't big enough to bypass our caches anyways
+        bool sequential = off == 0
+                || (file->block == ahead->block
+                    && off == ahead->off + ahead->size)
+                || (file->block == file->cache.block
+                    && off == file->cache.off + file->cache.size);
+        if (!sequential || size >= file->cfg->readahead_size) {
+            return lfs_bd_read(lfs,
+                    NULL, &file->cache, lfs->cfg->block_size,
+                    file->block, off, data, size);
+        }
+
+        // fill the read-ahead window, but don't read past the end of
+        // the file or block, this goes through lfs_bd_read so our other
+        // caches and any in-flight erases are still respected
+        lfs_off_t end = off + (file->ctz.size - (file->pos + (off-file->off)));
+        ahead->block = file->block;
+        ahead->off = lfs_aligndown(off, lfs->cfg->read_size);
+        ahead->size = lfs_min(
+                lfs_min(
+                    lfs_alignup(end, lfs->cfg->read_size),
+                    lfs->cfg->block_size)
+                - ahead->off,
+                file->cfg->readahead_size);
+        int err = lfs_bd_read(lfs,
+                NULL, &file->cache, ahead->size,
+                ahead->block, ahead->off, ahead->buffer, ahead->size);
         if (err) {
-            file->flags |= LFS_F_ERRED;
+            lfs_cache_drop(lfs, ahead);
             return err;
         }
-
-        file->flags &= ~LFS_F_DIRTY;
     }
 
     return 0;
@@ -3472,7 +5482,7 @@ static lfs_ssize_t lfs_file_flushedread(lfs_t *lfs, lfs_file_t *file,
                 file->off == lfs->cfg->block_size) {
             if (!(file->flags & LFS_F_INLINE)) {
                 int err = lfs_ctz_find(lfs, NULL, &file->cache,
-                        file->ctz.head, file->ctz.size,
+                        file->ctz.head, file->ctz.size, file,
                         file->pos, &file->block, &file->off);
                 if (err) {
                     return err;
@@ -3496,9 +5506,18 @@ static lfs_ssize_t lfs_file_flushedread(lfs_t *lfs, lfs_file_t *file,
             if (err) {
                 return err;
             }
+#ifdef LFS_READAHEAD
+        } else if (file->ahead.buffer) {
+            int err = lfs_file_readahead(lfs, file, data, diff);
+            if (err) {
+                return err;
+            }
+#endif
         } else {
+            // hint at most a cache's worth, so large aligned reads bypass
+            // our cache and go straight into the user's buffer
             int err = lfs_bd_read(lfs,
-                    NULL, &file->cache, lfs->cfg->block_size,
+                    NULL, &file->cache, lfs->cfg->cache_size,
                     file->block, file->off, data, diff);
             if (err) {
                 return err;
@@ -3531,6 +5550,40 @@ static lfs_ssize_t lfs_file_read_(lfs_t *lfs, lfs_file_t *file,
     return lfs_file_flushedread(lfs, file, buffer, size);
 }
 
+#ifdef LFS_READV
+static lfs_ssize_t lfs_file_readv_(lfs_t *lfs, lfs_file_t *file,
+        const struct lfs_iovec *iov, lfs_size_t count) {
+    LFS_ASSERT((file->flags & LFS_O_RDONLY) == LFS_O_RDONLY);
+
+#ifndef LFS_READONLY
+    if (file->flags & LFS_F_WRITING) {
+        // flush out any writes
+        int err = lfs_file_flush(lfs, file);
+        if (err) {
+            return err;
+        }
+    }
+#endif
+
+    lfs_size_t size = 0;
+    for (lfs_size_t i = 0; i < count; i++) {
+        lfs_ssize_t res = lfs_file_flushedread(lfs, file,
+                iov[i].buffer, iov[i].size);
+        if (res < 0) {
+            return res;
+        }
+
+        size += res;
+        if ((lfs_size_t)res < iov[i].size) {
+            // eof
+            break;
+        }
+    }
+
+    return size;
+}
+#endif
+
 
 #ifndef LFS_READONLY
 static lfs_ssize_t lfs_file_flushedwrite(lfs_t *lfs, lfs_file_t *file,
@@ -3556,7 +5609,7 @@ static lfs_ssize_t lfs_file_flushedwrite(lfs_t *lfs, lfs_file_t *file,
                 if (!(file->flags & LFS_F_WRITING) && file->pos > 0) {
                     // find out which block we're extending from
                     int err = lfs_ctz_find(lfs, NULL, &file->cache,
-                            file->ctz.head, file->ctz.size,
+                            file->ctz.head, file->ctz.size, file,
                             file->pos-1, &file->block, &(lfs_off_t){0});
                     if (err) {
                         file->flags |= LFS_F_ERRED;
@@ -3567,10 +5620,14 @@ static lfs_ssize_t lfs_file_flushedwrite(lfs_t *lfs, lfs_file_t *file,
                     lfs_cache_zero(lfs, &file->cache);
                 }
 
+                // blocks after our position are about to be rewritten
+                lfs_ctz_dropindex(lfs, file,
+                        (file->pos > 0) ? file->pos-1 : 0);
+
                 // extend file with new blocks
                 lfs_alloc_ckpoint(lfs);
                 int err = lfs_ctz_extend(lfs, &file->cache, &lfs->rcache,
-                        file->block, file->pos,
+                        file->block, file->pos, file,
                         &file->block, &file->off);
                 if (err) {
                     file->flags |= LFS_F_ERRED;
@@ -3617,10 +5674,8 @@ relocate:
     return size;
 }
 
-static lfs_ssize_t lfs_file_write_(lfs_t *lfs, lfs_file_t *file,
-        const void *buffer, lfs_size_t size) {
-    LFS_ASSERT((file->flags & LFS_O_WRONLY) == LFS_O_WRONLY);
-
+static int lfs_file_prepwrite(lfs_t *lfs, lfs_file_t *file,
+        lfs_size_t size) {
     if (file->flags & LFS_F_READING) {
         // drop any reads
         int err = lfs_file_flush(lfs, file);
@@ -3651,6 +5706,18 @@ static lfs_ssize_t lfs_file_write_(lfs_t *lfs, lfs_file_t *file,
         }
     }
 
+    return 0;
+}
+
+static lfs_ssize_t lfs_file_write_(lfs_t *lfs, lfs_file_t *file,
+        const void *buffer, lfs_size_t size) {
+    LFS_ASSERT((file->flags & LFS_O_WRONLY) == LFS_O_WRONLY);
+
+    int err = lfs_file_prepwrite(lfs, file, size);
+    if (err) {
+        return err;
+    }
+
     lfs_ssize_t nsize = lfs_file_flushedwrite(lfs, file, buffer, size);
     if (nsize < 0) {
         return nsize;
@@ -3659,6 +5726,39 @@ static lfs_ssize_t lfs_file_write_(lfs_t *lfs, lfs_file_t *file,
     file->flags &= ~LFS_F_ERRED;
     return nsize;
 }
+
+#ifdef LFS_READV
+static lfs_ssize_t lfs_file_writev_(lfs_t *lfs, lfs_file_t *file,
+        const struct lfs_iovec *iov, lfs_size_t count) {
+    LFS_ASSERT((file->flags & LFS_O_WRONLY) == LFS_O_WRONLY);
+
+    lfs_size_t size = 0;
+    for (lfs_size_t i = 0; i < count; i++) {
+        if (iov[i].size > lfs->file_max - size) {
+            // Larger than file limit?
+            return LFS_ERR_FBIG;
+        }
+
+        size += iov[i].size;
+    }
+
+    int err = lfs_file_prepwrite(lfs, file, size);
+    if (err) {
+        return err;
+    }
+
+    for (lfs_size_t i = 0; i < count; i++) {
+        lfs_ssize_t res = lfs_file_flushedwrite(lfs, file,
+                iov[i].buffer, iov[i].size);
+        if (res < 0) {
+            return res;
+        }
+    }
+
+    file->flags &= ~LFS_F_ERRED;
+    return size;
+}
+#endif
 #endif
 
 static lfs_soff_t lfs_file_seek_(lfs_t *lfs, lfs_file_t *file,
@@ -3692,37 +5792,231 @@ static lfs_soff_t lfs_file_seek_(lfs_t *lfs, lfs_file_t *file,
         return npos;
     }
 
-    // if we're only reading and our new offset is still in the file's cache
-    // we can avoid flushing and needing to reread the data
-    if (
-#ifndef LFS_READONLY
-        !(file->flags & LFS_F_WRITING)
-#else
-        true
-#endif
-            ) {
-        int oindex = lfs_ctz_index(lfs, &(lfs_off_t){file->pos});
+    // if we're only reading and our new offset is still in the current
+    // block we can avoid flushing, keeping our caches and our place in the
+    // skip-list, note we check that our offset matches our position, our
+    // block may already be behind us if we read up to its end
+    if (file->flags & LFS_F_READING) {
+        lfs_off_t ooff = file->pos;
+        int oindex = lfs_ctz_index(lfs, &ooff);
         lfs_off_t noff = npos;
         int nindex = lfs_ctz_index(lfs, &noff);
-        if (oindex == nindex
-                && noff >= file->cache.off
-                && noff < file->cache.off + file->cache.size) {
+        if (oindex == nindex && ooff == file->off) {
             file->pos = npos;
             file->off = noff;
             return npos;
         }
     }
 
-    // write out everything beforehand, may be noop if rdonly
-    int err = lfs_file_flush(lfs, file);
-    if (err) {
-        return err;
+    // write out everything beforehand, may be noop if rdonly
+    int err = lfs_file_flush(lfs, file);
+    if (err) {
+        return err;
+    }
+
+    // update pos
+    file->pos = npos;
+    return npos;
+}
+
+#ifdef LFS_PREAD
+static lfs_ssize_t lfs_file_pread_(lfs_t *lfs, lfs_file_t *file,
+        void *buffer, lfs_size_t size, lfs_off_t off) {
+    LFS_ASSERT((file->flags & LFS_O_RDONLY) == LFS_O_RDONLY);
+
+#ifndef LFS_READONLY
+    if (file->flags & LFS_F_WRITING) {
+        // flush out any writes
+        int err = lfs_file_flush(lfs, file);
+        if (err) {
+            return err;
+        }
+    }
+#endif
+
+    if (off >= file->ctz.size) {
+        // eof if past end
+        return 0;
+    }
+
+    size = lfs_min(size, file->ctz.size - off);
+
+    if (file->flags & LFS_F_INLINE) {
+        int err = lfs_dir_getread(lfs, &file->m,
+                NULL, &file->cache, lfs->cfg->block_size,
+                LFS_MKTAG(0xfff, 0x1ff, 0),
+                LFS_MKTAG(LFS_TYPE_INLINESTRUCT, file->id, 0),
+                off, buffer, size);
+        if (err) {
+            return err;
+        }
+
+        return size;
+    }
+
+    // we read without changing our position, but if we're reading we may
+    // already know where the block at our position is
+    lfs_off_t poff = file->pos;
+    int pindex = lfs_ctz_index(lfs, &poff);
+    bool reading = (file->flags & LFS_F_READING) && poff == file->off;
+
+    uint8_t *data = buffer;
+    lfs_size_t nsize = size;
+    while (nsize > 0) {
+        lfs_block_t block;
+        lfs_off_t boff = off;
+        if (reading && lfs_ctz_index(lfs, &boff) == pindex) {
+            block = file->block;
+        } else {
+            int err = lfs_ctz_find(lfs, NULL, &file->cache,
+                    file->ctz.head, file->ctz.size, file,
+                    off, &block, &boff);
+            if (err) {
+                return err;
+            }
+        }
+
+        // read as much as we can in this block
+        lfs_size_t diff = lfs_min(nsize, lfs->cfg->block_size - boff);
+        int err = lfs_bd_read(lfs,
+                NULL, &file->cache, lfs->cfg->cache_size,
+                block, boff, data, diff);
+        if (err) {
+            return err;
+        }
+
+        off += diff;
+        data += diff;
+        nsize -= diff;
+    }
+
+    if (!reading) {
+        // we may have filled our cache, mark the file as reading so our
+        // cache is dropped before any writes, but with no known block
+        file->flags |= LFS_F_READING;
+        file->off = lfs->cfg->block_size;
+    }
+
+    return size;
+}
+#endif
+
+#if !defined(LFS_READONLY) && defined(LFS_PREAD)
+static lfs_ssize_t lfs_file_pwrite_(lfs_t *lfs, lfs_file_t *file,
+        const void *buffer, lfs_size_t size, lfs_off_t off) {
+    LFS_ASSERT((file->flags & LFS_O_WRONLY) == LFS_O_WRONLY);
+
+    lfs_off_t pos = file->pos;
+    lfs_ssize_t nsize = lfs_file_seek_(lfs, file, off, LFS_SEEK_SET);
+    if (nsize >= 0) {
+        nsize = lfs_file_write_(lfs, file, buffer, size);
+    }
+
+    // restore our position, note this flushes our write, we need to do
+    // this even if we failed
+    lfs_soff_t res = lfs_file_seek_(lfs, file, pos, LFS_SEEK_SET);
+    if (res < 0) {
+        // if we couldn't flush, we can't trust our pending write, but we
+        // can at least keep our position
+        if (file->flags & LFS_F_WRITING) {
+            file->flags |= LFS_F_ERRED;
+        }
+        file->pos = pos;
+        return (nsize < 0) ? nsize : res;
+    }
+
+    return nsize;
+}
+#endif
+
+#if !defined(LFS_READONLY) && defined(LFS_RESERVE)
+static int lfs_file_reserve_(lfs_t *lfs, lfs_file_t *file, lfs_off_t size) {
+    LFS_ASSERT((file->flags & LFS_O_WRONLY) == LFS_O_WRONLY);
+
+    if (size > lfs->file_max) {
+        return LFS_ERR_FBIG;
+    }
+
+    // forget any previous reservation
+    lfs_alloc_release(lfs, &file->extent);
+
+    // do we need any blocks?
+    lfs_off_t fsize = lfs_file_size_(lfs, file);
+    if (size <= fsize
+            || ((file->flags & LFS_F_INLINE) && size <= lfs->inline_max)) {
+        return 0;
+    }
+
+    // find how many blocks we need, if we aren't already writing, the
+    // first write also copies our last block
+    lfs_block_t count = lfs_ctz_index(lfs, &(lfs_off_t){size-1}) + 1;
+    lfs_block_t prev = LFS_BLOCK_NULL;
+    if (!(file->flags & LFS_F_INLINE) && fsize > 0) {
+        count -= lfs_ctz_index(lfs, &(lfs_off_t){fsize-1}) + 1;
+        if (file->flags & LFS_F_WRITING) {
+            prev = file->block;
+        } else {
+            prev = file->ctz.head;
+            count += 1;
+        }
+    }
+
+    // reserve a run of blocks, preferably right after our last block,
+    // otherwise at the longest run we can find
+    lfs_alloc_ckpoint(lfs);
+    lfs_block_t nblock = LFS_BLOCK_NULL;
+    if (prev != LFS_BLOCK_NULL && prev+1 < lfs->block_count
+            && lfs_alloc_isfree(lfs, prev+1)) {
+        nblock = prev+1;
+    }
+
+    for (lfs_block_t n = count; nblock == LFS_BLOCK_NULL && n > 0; n /= 2) {
+        nblock = lfs_alloc_findrun(lfs, n);
+    }
+
+    if (nblock != LFS_BLOCK_NULL) {
+        lfs_alloc_take(lfs, nblock);
+    } else {
+        int err = lfs_alloc(lfs, &nblock);
+        if (err) {
+            return err;
+        }
+    }
+
+    file->extent.block = nblock;
+    file->extent.count = 1;
+    while (file->extent.count < count
+            && nblock+file->extent.count < lfs->block_count
+            && lfs_alloc_isfree(lfs, nblock+file->extent.count)) {
+        lfs_alloc_take(lfs, nblock+file->extent.count);
+        file->extent.count += 1;
+    }
+
+    // erase everything up front
+    for (lfs_block_t i = 0; i < file->extent.count; i++) {
+        int err = lfs_bd_erase(lfs, nblock+i);
+        if (err) {
+            if (err == LFS_ERR_CORRUPT) {
+                // keep what we've erased, the bad block will be found
+                // again if it's ever allocated
+                struct lfs_extent rest = {
+                    .block = nblock+i,
+                    .count = file->extent.count-i,
+                };
+                lfs_alloc_release(lfs, &rest);
+                file->extent.count = i;
+                break;
+            }
+
+            lfs_alloc_release(lfs, &file->extent);
+            return err;
+        }
     }
 
-    // update pos
-    file->pos = npos;
-    return npos;
+    file->extent.reserved = (file->extent.count > 0);
+    return 0;
 }
+#endif
 
 #ifndef LFS_READONLY
 static int lfs_file_truncate_(lfs_t *lfs, lfs_file_t *file, lfs_off_t size) {
@@ -3754,6 +6048,7 @@ static int lfs_file_truncate_(lfs_t *lfs, lfs_file_t *file, lfs_off_t size) {
             file->ctz.head = LFS_BLOCK_INLINE;
             file->ctz.size = size;
             file->flags |= LFS_F_DIRTY | LFS_F_READING | LFS_F_INLINE;
+            lfs_ctz_dropindex(lfs, file, 0);
             file->cache.block = file->ctz.head;
             file->cache.off = 0;
             file->cache.size = lfs->cfg->cache_size;
@@ -3768,8 +6063,8 @@ static int lfs_file_truncate_(lfs_t *lfs, lfs_file_t *file, lfs_off_t size) {
 
             // lookup new head in ctz skip list
             err = lfs_ctz_find(lfs, NULL, &file->cache,
-                    file->ctz.head, file->ctz.size,
-                    size-1, &file->block, &(lfs_off_t){0});
+                    file->ctz.head, file->ctz.size, file,
+                    size-1, &file->block, &file->off);
             if (err) {
                 return err;
             }
@@ -3777,6 +6072,7 @@ static int lfs_file_truncate_(lfs_t *lfs, lfs_file_t *file, lfs_off_t size) {
             // need to set pos/block/off consistently so seeking back to
             // the old position does not get confused
             file->pos = size;
+            file->off += 1;
             file->ctz.head = file->block;
             file->ctz.size = size;
             file->flags |= LFS_F_DIRTY | LFS_F_READING;
@@ -3893,6 +6189,15 @@ static int lfs_remove_(lfs_t *lfs, const char *path) {
         lfs->mlist = &dir;
     }
 
+    // find the skip-list we're removing
+    struct lfs_ctz ctz = {.head = LFS_BLOCK_NULL, .size = 0};
+    if (lfs_tag_type3(tag) == LFS_TYPE_REG) {
+        err = lfs_ctz_getfree(lfs, NULL, &cwd, lfs_tag_id(tag), &ctz);
+        if (err) {
+            return err;
+        }
+    }
+
     // delete the entry
     err = lfs_dir_commit(lfs, &cwd, LFS_MKATTRS(
             {LFS_MKTAG(LFS_TYPE_DELETE, lfs_tag_id(tag), 0), NULL}));
@@ -3918,8 +6223,12 @@ static int lfs_remove_(lfs_t *lfs, const char *path) {
         if (err) {
             return err;
         }
+
+        lfs_alloc_free(lfs, dir.m.pair[0]);
+        lfs_alloc_free(lfs, dir.m.pair[1]);
     }
 
+    lfs_ctz_free(lfs, ctz.head, ctz.size, LFS_BLOCK_NULL, 0);
     return 0;
 }
 #endif
@@ -4007,6 +6316,16 @@ static int lfs_rename_(lfs_t *lfs, const char *oldpath, const char *newpath) {
         lfs->mlist = &prevdir;
     }
 
+    // find the skip-list we're replacing
+    struct lfs_ctz prevctz = {.head = LFS_BLOCK_NULL, .size = 0};
+    if (prevtag != LFS_ERR_NOENT
+            && lfs_tag_type3(prevtag) == LFS_TYPE_REG) {
+        err = lfs_ctz_getfree(lfs, NULL, &newcwd, newid, &prevctz);
+        if (err) {
+            return err;
+        }
+    }
+
     if (!samepair) {
         lfs_fs_prepmove(lfs, newoldid, oldcwd.pair);
     }
@@ -4056,8 +6375,12 @@ static int lfs_rename_(lfs_t *lfs, const char *oldpath, const char *newpath) {
         if (err) {
             return err;
         }
+
+        lfs_alloc_free(lfs, prevdir.m.pair[0]);
+        lfs_alloc_free(lfs, prevdir.m.pair[1]);
     }
 
+    lfs_ctz_free(lfs, prevctz.head, prevctz.size, LFS_BLOCK_NULL, 0);
     return 0;
 }
 #endif
@@ -4156,6 +6479,50 @@ static int lfs_removeattr_(lfs_t *lfs, const char *path, uint8_t type) {
 static int lfs_init(lfs_t *lfs, const struct lfs_config *cfg) {
     lfs->cfg = cfg;
     lfs->block_count = cfg->block_count;  // May be 0
+#ifdef LFS_READCACHE
+    lfs->rlines = NULL;
+#endif
+#ifdef LFS_PROGV
+    lfs->pbatch = NULL;
+    lfs->pbatch_count = 0;
+#endif
+#ifdef LFS_ASYNCERASE
+    lfs->inflight.blocks = NULL;
+    lfs->inflight.off = 0;
+    lfs->inflight.count = 0;
+    lfs->inflight.bad_count = 0;
+#endif
+#ifdef LFS_PREERASE
+    lfs->preerase.blocks = NULL;
+    lfs->preerase.count = 0;
+#endif
+#ifdef LFS_TRIM
+    lfs->trim.blocks = NULL;
+    lfs->trim.count = 0;
+#endif
+#ifdef LFS_LOOKUPCACHE
+    lfs->lookups = NULL;
+    lfs->lookup_next = 0;
+#endif
+#ifdef LFS_MDIRCACHE
+    lfs->mdirs = NULL;
+    lfs->mdir_next = 0;
+#endif
+#ifdef LFS_SUMMARY
+    lfs->summary.remaining = 0;
+    lfs->summary.buffer = NULL;
+#endif
+#ifdef LFS_BITMAP
+    lfs->bitmap.size = 0;
+    lfs->bitmap.next = 0;
+    lfs->bitmap.buffer = NULL;
+#endif
+#ifdef LFS_WEAR
+    lfs->wear = NULL;
+#endif
+#ifdef LFS_USEDCOUNT
+    lfs->used = LFS_BLOCK_NULL;
+#endif
     int err = 0;
 
 #ifdef LFS_MULTIVERSION
@@ -4248,6 +6615,154 @@ static int lfs_init(lfs_t *lfs, const struct lfs_config *cfg) {
         }
     }
 
+#ifdef LFS_SUMMARY
+    // setup free-space summary, this is recorded by the first scan
+    if (lfs->cfg->summary_size > 0) {
+        if (lfs->cfg->summary_buffer) {
+            lfs->summary.buffer = lfs->cfg->summary_buffer;
+        } else {
+            lfs->summary.buffer = lfs_malloc(lfs->cfg->summary_size);
+            if (!lfs->summary.buffer) {
+                err = LFS_ERR_NOMEM;
+                goto cleanup;
+            }
+        }
+    }
+#endif
+
+#ifdef LFS_BITMAP
+    // setup free-block bitmap, mount builds this on first allocation
+    if (lfs->cfg->bitmap_size > 0) {
+        LFS_ASSERT(lfs->cfg->block_count == 0
+                || 8*lfs->cfg->bitmap_size >= lfs->cfg->block_count);
+        if (lfs->cfg->bitmap_buffer) {
+            lfs->bitmap.buffer = lfs->cfg->bitmap_buffer;
+        } else {
+            lfs->bitmap.buffer = lfs_malloc(lfs->cfg->bitmap_size);
+            if (!lfs->bitmap.buffer) {
+                err = LFS_ERR_NOMEM;
+                goto cleanup;
+            }
+        }
+    }
+#endif
+
+#ifdef LFS_WEAR
+    // setup erase-count table, a user-provided table is left as is so
+    // counts can persist across mounts
+    if (lfs->cfg->wear_size > 0) {
+        LFS_ASSERT(lfs->cfg->block_count == 0
+                || lfs->cfg->wear_size >= lfs->cfg->block_count);
+        if (lfs->cfg->wear_buffer) {
+            lfs->wear = lfs->cfg->wear_buffer;
+        } else {
+            lfs->wear = lfs_malloc(lfs->cfg->wear_size);
+            if (!lfs->wear) {
+                err = LFS_ERR_NOMEM;
+                goto cleanup;
+            }
+            memset(lfs->wear, 0, lfs->cfg->wear_size);
+        }
+    }
+#endif
+
+#ifdef LFS_READCACHE
+    // setup additional read cache lines, line metadata and buffers share
+    // a single allocation
+    if (lfs->cfg->read_cache_count > 0) {
+        lfs->rlines = lfs_malloc(lfs->cfg->read_cache_count
+                * (sizeof(lfs_cache_t) + lfs->cfg->cache_size));
+        if (!lfs->rlines) {
+            err = LFS_ERR_NOMEM;
+            goto cleanup;
+        }
+
+        uint8_t *buffer = (uint8_t*)&lfs->rlines[lfs->cfg->read_cache_count];
+        for (lfs_size_t i = 0; i < lfs->cfg->read_cache_count; i++) {
+            lfs->rlines[i].buffer = &buffer[i*lfs->cfg->cache_size];
+            lfs_cache_drop(lfs, &lfs->rlines[i]);
+        }
+    }
+#endif
+
+#ifdef LFS_PROGV
+    // setup program batch buffers, this needs one extra segment for the
+    // pcache itself
+    if (lfs->cfg->prog_batch_count > 0) {
+        LFS_ASSERT(lfs->cfg->progv);
+        lfs->pbatch = lfs_malloc(
+                (lfs->cfg->prog_batch_count+1)*sizeof(struct lfs_segment)
+                + lfs->cfg->prog_batch_count*lfs->cfg->cache_size);
+        if (!lfs->pbatch) {
+            err = LFS_ERR_NOMEM;
+            goto cleanup;
+        }
+
+        uint8_t *buffer = (uint8_t*)&lfs->pbatch[
+                lfs->cfg->prog_batch_count+1];
+        for (lfs_size_t i = 0; i < lfs->cfg->prog_batch_count; i++) {
+            lfs->pbatch[i].buffer = &buffer[i*lfs->cfg->cache_size];
+        }
+    }
+#endif
+
+#ifdef LFS_ASYNCERASE
+    // setup queue of in-flight erases, this also needs room to remember
+    // bad erases
+    if (lfs->cfg->erase_depth > 0) {
+        LFS_ASSERT(lfs->cfg->erase_async);
+        LFS_ASSERT(lfs->cfg->complete);
+        lfs->inflight.blocks = lfs_malloc(
+                2*lfs->cfg->erase_depth*sizeof(lfs_block_t));
+        if (!lfs->inflight.blocks) {
+            err = LFS_ERR_NOMEM;
+            goto cleanup;
+        }
+    }
+#endif
+
+#ifdef LFS_PREERASE
+    // setup pool of pre-erased blocks
+    if (lfs->cfg->preerase_count > 0) {
+        lfs->preerase.blocks = lfs_malloc(
+                lfs->cfg->preerase_count*sizeof(lfs_block_t));
+        if (!lfs->preerase.blocks) {
+            err = LFS_ERR_NOMEM;
+            goto cleanup;
+        }
+    }
+#endif
+
+#ifdef LFS_MDIRCACHE
+    // setup cache of fetched mdirs
+    if (lfs->cfg->mdir_cache_count > 0) {
+        lfs->mdirs = lfs_malloc(
+                lfs->cfg->mdir_cache_count*sizeof(lfs_mdir_t));
+        if (!lfs->mdirs) {
+            err = LFS_ERR_NOMEM;
+            goto cleanup;
+        }
+
+        for (lfs_size_t i = 0; i < lfs->cfg->mdir_cache_count; i++) {
+            lfs->mdirs[i].pair[0] = LFS_BLOCK_NULL;
+            lfs->mdirs[i].pair[1] = LFS_BLOCK_NULL;
+        }
+    }
+#endif
+
+#ifdef LFS_TRIM
+    // setup queue of blocks to trim
+    if (lfs->cfg->trim_count > 0) {
+        LFS_ASSERT(lfs->cfg->trim);
+        lfs->trim.blocks = lfs_malloc(
+                lfs->cfg->trim_count*sizeof(lfs_block_t));
+        if (!lfs->trim.blocks) {
+            err = LFS_ERR_NOMEM;
+            goto cleanup;
+        }
+    }
+#endif
+
     // check that the size limits are sane
     LFS_ASSERT(lfs->cfg->name_max <= LFS_NAME_MAX);
     lfs->name_max = lfs->cfg->name_max;
@@ -4267,6 +6782,32 @@ static int lfs_init(lfs_t *lfs, const struct lfs_config *cfg) {
         lfs->attr_max = LFS_ATTR_MAX;
     }
 
+#ifdef LFS_LOOKUPCACHE
+    // setup lookup cache, entries and names share a single allocation
+    if (lfs->cfg->lookup_count > 0) {
+        lfs->lookups = lfs_malloc(lfs->cfg->lookup_count
+                * (sizeof(struct lfs_lookup) + lfs->name_max));
+        if (!lfs->lookups) {
+            err = LFS_ERR_NOMEM;
+            goto cleanup;
+        }
+
+        char *name = (char*)&lfs->lookups[lfs->cfg->lookup_count];
+        for (lfs_size_t i = 0; i < lfs->cfg->lookup_count; i++) {
+            struct lfs_lookup *l = &lfs->lookups[i];
+            l->name = &name[i*lfs->name_max];
+            l->parent[0] = LFS_BLOCK_NULL;
+            l->parent[1] = LFS_BLOCK_NULL;
+            l->pair[0] = LFS_BLOCK_NULL;
+            l->pair[1] = LFS_BLOCK_NULL;
+            l->child[0] = LFS_BLOCK_NULL;
+            l->child[1] = LFS_BLOCK_NULL;
+            l->tag = 0;
+            l->hash = 0;
+        }
+    }
+#endif
+
     LFS_ASSERT(lfs->cfg->metadata_max <= lfs->cfg->block_size);
 
     LFS_ASSERT(lfs->cfg->inline_max == (lfs_size_t)-1
@@ -4293,6 +6834,10 @@ static int lfs_init(lfs_t *lfs, const struct lfs_config *cfg) {
     // setup default state
     lfs->root[0] = LFS_BLOCK_NULL;
     lfs->root[1] = LFS_BLOCK_NULL;
+#ifdef LFS_GCSTEP
+    lfs->gctail[0] = 0;
+    lfs->gctail[1] = 1;
+#endif
     lfs->mlist = NULL;
     lfs->seed = 0;
     lfs->gdisk = (lfs_gstate_t){0};
@@ -4310,6 +6855,12 @@ cleanup:
 }
 
 static int lfs_deinit(lfs_t *lfs) {
+    int err = 0;
+#ifndef LFS_READONLY
+    // wait for any in-flight erases
+    err = lfs_bd_complete(lfs, LFS_BLOCK_NULL);
+#endif
+
     // free allocated memory
     if (!lfs->cfg->read_buffer) {
         lfs_free(lfs->rcache.buffer);
@@ -4323,7 +6874,47 @@ static int lfs_deinit(lfs_t *lfs) {
         lfs_free(lfs->lookahead.buffer);
     }
 
-    return 0;
+#ifdef LFS_SUMMARY
+    if (!lfs->cfg->summary_buffer) {
+        lfs_free(lfs->summary.buffer);
+    }
+#endif
+
+#ifdef LFS_BITMAP
+    if (!lfs->cfg->bitmap_buffer) {
+        lfs_free(lfs->bitmap.buffer);
+    }
+#endif
+
+#ifdef LFS_WEAR
+    if (!lfs->cfg->wear_buffer) {
+        lfs_free(lfs->wear);
+    }
+#endif
+
+#ifdef LFS_READCACHE
+    lfs_free(lfs->rlines);
+#endif
+#ifdef LFS_PROGV
+    lfs_free(lfs->pbatch);
+#endif
+#ifdef LFS_ASYNCERASE
+    lfs_free(lfs->inflight.blocks);
+#endif
+#ifdef LFS_PREERASE
+    lfs_free(lfs->preerase.blocks);
+#endif
+#ifdef LFS_TRIM
+    lfs_free(lfs->trim.blocks);
+#endif
+#ifdef LFS_LOOKUPCACHE
+    lfs_free(lfs->lookups);
+#endif
+#ifdef LFS_MDIRCACHE
+    lfs_free(lfs->mdirs);
+#endif
+
+    return err;
 }
 
 
@@ -4345,6 +6936,13 @@ static int lfs_format_(lfs_t *lfs, const struct lfs_config *cfg) {
         lfs->lookahead.size = lfs_min(8*lfs->cfg->lookahead_size,
                 lfs->block_count);
         lfs->lookahead.next = 0;
+#ifdef LFS_BITMAP
+        if (lfs->cfg->bitmap_size > 0) {
+            memset(lfs->bitmap.buffer, 0, lfs->cfg->bitmap_size);
+            lfs->bitmap.size = lfs->block_count;
+            lfs->bitmap.free = lfs->block_count;
+        }
+#endif
         lfs_alloc_ckpoint(lfs);
 
         // create root dir
@@ -4559,6 +7157,9 @@ static int lfs_mount_(lfs_t *lfs, const struct lfs_config *cfg) {
     // setup free lookahead, to distribute allocations uniformly across
     // boots, we start the allocator at a random location
     lfs->lookahead.start = lfs->seed % lfs->block_count;
+#ifdef LFS_BITMAP
+    lfs->bitmap.next = lfs->lookahead.start;
+#endif
     lfs_alloc_drop(lfs);
 
     return 0;
@@ -5036,6 +7637,15 @@ static int lfs_fs_deorphan(lfs_t *lfs, bool powerloss) {
                         return state;
                     }
 
+                    #ifdef LFS_GCSTEP
+                    // skip our gc cursor past the orphan
+                    if (lfs_pair_cmp(dir.pair, lfs->gctail) == 0) {
+                        lfs->gctail[0] = dir.tail[0];
+                        lfs->gctail[1] = dir.tail[1];
+                    }
+                    #endif
+                    lfs_alloc_count(lfs, 2, false);
+
                     // did our commit create more orphans?
                     if (state == LFS_OK_ORPHANED) {
                         moreorphans = true;
@@ -5116,18 +7726,39 @@ static int lfs_fs_size_count(void *p, lfs_block_t block) {
 }
 
 static lfs_ssize_t lfs_fs_size_(lfs_t *lfs) {
+    #ifdef LFS_USEDCOUNT
+    // we only need to traverse the filesystem if we don't already have a
+    // count of in-use blocks
+    if (lfs->used != LFS_BLOCK_NULL) {
+        return lfs->used;
+    }
+    #endif
+
     lfs_size_t size = 0;
     int err = lfs_fs_traverse_(lfs, lfs_fs_size_count, &size, false);
     if (err) {
         return err;
     }
 
+    #ifdef LFS_EXTENTS
+    // blocks reserved for open files' extents are in-use as far as
+    // the allocator is concerned
+    for (lfs_file_t *f = (lfs_file_t*)lfs->mlist; f; f = f->next) {
+        if (f->type == LFS_TYPE_REG) {
+            size += f->extent.count;
+        }
+    }
+    #endif
+
+    #ifdef LFS_USEDCOUNT
+    lfs->used = size;
+    #endif
     return size;
 }
 
 // explicit garbage collection
 #ifndef LFS_READONLY
-static int lfs_fs_gc_(lfs_t *lfs) {
+static int lfs_fs_gcstep_(lfs_t *lfs, lfs_size_t steps) {
     // force consistency, even if we're not necessarily going to write,
     // because this function is supposed to take care of janitorial work
     // isn't it?
@@ -5136,18 +7767,34 @@ static int lfs_fs_gc_(lfs_t *lfs) {
         return err;
     }
 
+    // without incremental gc every call is a full pass, so our cursor
+    // doesn't need to outlive the call
+    #ifdef LFS_GCSTEP
+    lfs_block_t *tail = lfs->gctail;
+    #else
+    lfs_block_t tail[2] = {0, 1};
+    #endif
+
     // try to compact metadata pairs, note we can't really accomplish
     // anything if compact_thresh doesn't at least leave a prog_size
     // available
     if (lfs->cfg->compact_thresh
             < lfs->cfg->block_size - lfs->cfg->prog_size) {
-        // iterate over all mdirs
-        lfs_mdir_t mdir = {.tail = {0, 1}};
-        while (!lfs_pair_isnull(mdir.tail)) {
-            err = lfs_dir_fetch(lfs, &mdir, mdir.tail);
+        // iterate over mdirs, resuming from our cursor, relocations and
+        // drops keep our cursor up to date between calls
+        while (!lfs_pair_isnull(tail)) {
+            if (steps == 0) {
+                return 1;
+            }
+            steps -= 1;
+
+            lfs_mdir_t mdir;
+            err = lfs_dir_fetch(lfs, &mdir, tail);
             if (err) {
                 return err;
             }
+            tail[0] = mdir.tail[0];
+            tail[1] = mdir.tail[1];
 
             // not erased? exceeds our compaction threshold?
             if (!mdir.erased || ((lfs->cfg->compact_thresh == 0)
@@ -5164,18 +7811,80 @@ static int lfs_fs_gc_(lfs_t *lfs) {
         }
     }
 
-    // try to populate the lookahead buffer, unless it's already full
+    // try to populate the lookahead buffer, unless it's already full, or
+    // rebuild the bitmap to reclaim any blocks it has leaked
+    if (steps == 0) {
+        tail[0] = LFS_BLOCK_NULL;
+        tail[1] = LFS_BLOCK_NULL;
+        return 1;
+    }
+
+    #ifdef LFS_BITMAP
+    if (lfs->cfg->bitmap_size > 0) {
+        err = lfs_alloc_bitmapscan(lfs);
+        if (err) {
+            return err;
+        }
+    } else if (lfs->lookahead.size < 8*lfs->cfg->lookahead_size) {
+    #else
     if (lfs->lookahead.size < 8*lfs->cfg->lookahead_size) {
+    #endif
         err = lfs_alloc_scan(lfs);
         if (err) {
             return err;
         }
     }
 
+    #ifdef LFS_USEDCOUNT
+    // correct our count of in-use blocks, if we have one, this picks up
+    // any blocks left behind by relocations or rewritten files
+    if (lfs->used != LFS_BLOCK_NULL) {
+        lfs->used = LFS_BLOCK_NULL;
+        lfs_ssize_t size = lfs_fs_size_(lfs);
+        if (size < 0) {
+            return size;
+        }
+    }
+    #endif
+
+    #ifdef LFS_PREERASE
+    // erase the blocks we're going to allocate next ahead of time
+    if (lfs->cfg->preerase_count > 0) {
+        err = lfs_alloc_preerase(lfs);
+        if (err) {
+            return err;
+        }
+    }
+    #endif
+
+    #ifdef LFS_TRIM
+    // let the block device know about any blocks we've freed
+    if (lfs->cfg->trim_count > 0) {
+        err = lfs_bd_trim(lfs);
+        if (err) {
+            return err;
+        }
+    }
+    #endif
+
+    // start over on the next pass
+    tail[0] = 0;
+    tail[1] = 1;
     return 0;
 }
 #endif
 
+#ifndef LFS_READONLY
+static int lfs_fs_gc_(lfs_t *lfs) {
+    #ifdef LFS_GCSTEP
+    // always do a full pass
+    lfs->gctail[0] = 0;
+    lfs->gctail[1] = 1;
+    #endif
+    return lfs_fs_gcstep_(lfs, -1);
+}
+#endif
+
 #ifndef LFS_READONLY
 static int lfs_fs_grow_(lfs_t *lfs, lfs_size_t block_count) {
     // shrinking is not supported
@@ -5183,6 +7892,12 @@ static int lfs_fs_grow_(lfs_t *lfs, lfs_size_t block_count) {
 
     if (block_count > lfs->block_count) {
         lfs->block_count = block_count;
+        // our summary no longer covers the whole disk, and any reserved
+        // extents are relative to the old block count
+        #ifdef LFS_SUMMARY
+        lfs->summary.remaining = 0;
+        #endif
+        lfs_alloc_dropextents(lfs);
 
         // fetch the root
         lfs_mdir_t root;
@@ -6118,6 +8833,27 @@ int lfs_file_sync(lfs_t *lfs, lfs_file_t *file) {
     LFS_UNLOCK(lfs->cfg);
     return err;
 }
+
+#ifdef LFS_SYNCV
+int lfs_file_syncv(lfs_t *lfs, lfs_file_t *const *files, lfs_size_t count) {
+    int err = LFS_LOCK(lfs->cfg);
+    if (err) {
+        return err;
+    }
+    LFS_TRACE("lfs_file_syncv(%p, %p, %"PRIu32")",
+            (void*)lfs, (void*)files, count);
+    for (lfs_size_t i = 0; i < count; i++) {
+        LFS_ASSERT(lfs_mlist_isopen(lfs->mlist,
+                (struct lfs_mlist*)files[i]));
+    }
+
+    err = lfs_file_syncv_(lfs, files, count);
+
+    LFS_TRACE("lfs_file_syncv -> %d", err);
+    LFS_UNLOCK(lfs->cfg);
+    return err;
+}
+#endif
 #endif
 
 lfs_ssize_t lfs_file_read(lfs_t *lfs, lfs_file_t *file,
@@ -6156,6 +8892,82 @@ lfs_ssize_t lfs_file_write(lfs_t *lfs, lfs_file_t *file,
 }
 #endif
 
+#ifdef LFS_READV
+lfs_ssize_t lfs_file_readv(lfs_t *lfs, lfs_file_t *file,
+        const struct lfs_iovec *iov, lfs_size_t count) {
+    int err = LFS_LOCK(lfs->cfg);
+    if (err) {
+        return err;
+    }
+    LFS_TRACE("lfs_file_readv(%p, %p, %p, %"PRIu32")",
+            (void*)lfs, (void*)file, (void*)iov, count);
+    LFS_ASSERT(lfs_mlist_isopen(lfs->mlist, (struct lfs_mlist*)file));
+
+    lfs_ssize_t res = lfs_file_readv_(lfs, file, iov, count);
+
+    LFS_TRACE("lfs_file_readv -> %"PRId32, res);
+    LFS_UNLOCK(lfs->cfg);
+    return res;
+}
+#endif
+
+#if !defined(LFS_READONLY) && defined(LFS_READV)
+lfs_ssize_t lfs_file_writev(lfs_t *lfs, lfs_file_t *file,
+        const struct lfs_iovec *iov, lfs_size_t count) {
+    int err = LFS_LOCK(lfs->cfg);
+    if (err) {
+        return err;
+    }
+    LFS_TRACE("lfs_file_writev(%p, %p, %p, %"PRIu32")",
+            (void*)lfs, (void*)file, (void*)iov, count);
+    LFS_ASSERT(lfs_mlist_isopen(lfs->mlist, (struct lfs_mlist*)file));
+
+    lfs_ssize_t res = lfs_file_writev_(lfs, file, iov, count);
+
+    LFS_TRACE("lfs_file_writev -> %"PRId32, res);
+    LFS_UNLOCK(lfs->cfg);
+    return res;
+}
+#endif
+
+#ifdef LFS_PREAD
+lfs_ssize_t lfs_file_pread(lfs_t *lfs, lfs_file_t *file,
+        void *buffer, lfs_size_t size, lfs_off_t off) {
+    int err = LFS_LOCK(lfs->cfg);
+    if (err) {
+        return err;
+    }
+    LFS_TRACE("lfs_file_pread(%p, %p, %p, %"PRIu32", %"PRIu32")",
+            (void*)lfs, (void*)file, buffer, size, off);
+    LFS_ASSERT(lfs_mlist_isopen(lfs->mlist, (struct lfs_mlist*)file));
+
+    lfs_ssize_t res = lfs_file_pread_(lfs, file, buffer, size, off);
+
+    LFS_TRACE("lfs_file_pread -> %"PRId32, res);
+    LFS_UNLOCK(lfs->cfg);
+    return res;
+}
+#endif
+
+#if !defined(LFS_READONLY) && defined(LFS_PREAD)
+lfs_ssize_t lfs_file_pwrite(lfs_t *lfs, lfs_file_t *file,
+        const void *buffer, lfs_size_t size, lfs_off_t off) {
+    int err = LFS_LOCK(lfs->cfg);
+    if (err) {
+        return err;
+    }
+    LFS_TRACE("lfs_file_pwrite(%p, %p, %p, %"PRIu32", %"PRIu32")",
+            (void*)lfs, (void*)file, buffer, size, off);
+    LFS_ASSERT(lfs_mlist_isopen(lfs->mlist, (struct lfs_mlist*)file));
+
+    lfs_ssize_t res = lfs_file_pwrite_(lfs, file, buffer, size, off);
+
+    LFS_TRACE("lfs_file_pwrite -> %"PRId32, res);
+    LFS_UNLOCK(lfs->cfg);
+    return res;
+}
+#endif
+
 lfs_soff_t lfs_file_seek(lfs_t *lfs, lfs_file_t *file,
         lfs_soff_t off, int whence) {
     int err = LFS_LOCK(lfs->cfg);
@@ -6191,6 +9003,24 @@ int lfs_file_truncate(lfs_t *lfs, lfs_file_t *file, lfs_off_t size) {
 }
 #endif
 
+#if !defined(LFS_READONLY) && defined(LFS_RESERVE)
+int lfs_file_reserve(lfs_t *lfs, lfs_file_t *file, lfs_off_t size) {
+    int err = LFS_LOCK(lfs->cfg);
+    if (err) {
+        return err;
+    }
+    LFS_TRACE("lfs_file_reserve(%p, %p, %"PRIu32")",
+            (void*)lfs, (void*)file, size);
+    LFS_ASSERT(lfs_mlist_isopen(lfs->mlist, (struct lfs_mlist*)file));
+
+    err = lfs_file_reserve_(lfs, file, size);
+
+    LFS_TRACE("lfs_file_reserve -> %d", err);
+    LFS_UNLOCK(lfs->cfg);
+    return err;
+}
+#endif
+
 lfs_soff_t lfs_file_tell(lfs_t *lfs, lfs_file_t *file) {
     int err = LFS_LOCK(lfs->cfg);
     if (err) {
@@ -6413,6 +9243,22 @@ int lfs_fs_gc(lfs_t *lfs) {
 }
 #endif
 
+#if !defined(LFS_READONLY) && defined(LFS_GCSTEP)
+int lfs_fs_gcstep(lfs_t *lfs, lfs_size_t steps) {
+    int err = LFS_LOCK(lfs->cfg);
+    if (err) {
+        return err;
+    }
+    LFS_TRACE("lfs_fs_gcstep(%p, %"PRIu32")", (void*)lfs, steps);
+
+    err = lfs_fs_gcstep_(lfs, steps);
+
+    LFS_TRACE("lfs_fs_gcstep -> %d", err);
+    LFS_UNLOCK(lfs->cfg);
+    return err;
+}
+#endif
+
 #ifndef LFS_READONLY
 int lfs_fs_grow(lfs_t *lfs, lfs_size_t block_count) {
     int err = LFS_LOCK(lfs->cfg);
@@ -65,6 +65,18 @@ typedef uint32_t lfs_block_t;
 #define LFS_ATTR_MAX 1022
 #endif
 
+// Maximum number of files lfs_file_syncv writes with a single commit, may be
+// redefined to trade stack usage for larger atomic groups.
+#ifndef LFS_SYNCV_MAX
+#define LFS_SYNCV_MAX 8
+#endif
+
+// lfs_file_reserve keeps the blocks it reserves in the file's extent, so
+// LFS_RESERVE requires LFS_EXTENTS
+#if defined(LFS_RESERVE) && !defined(LFS_EXTENTS)
+#define LFS_EXTENTS
+#endif
+
 // Possible error codes, these are negative to allow
 // valid positive return values
 enum lfs_error {
@@ -153,6 +165,21 @@ enum lfs_whence_flags {
 };
 
 
+// A region of a block, used by vectored block device operations
+struct lfs_segment {
+    // Block containing the region
+    lfs_block_t block;
+
+    // Offset of the region in the block
+    lfs_off_t off;
+
+    // Data to program into the region
+    const void *buffer;
+
+    // Size of the region in bytes
+    lfs_size_t size;
+};
+
 // Configuration provided during initialization of the littlefs
 struct lfs_config {
     // Opaque user provided context that can be used to pass
@@ -180,6 +207,38 @@ struct lfs_config {
     // are propagated to the user.
     int (*sync)(const struct lfs_config *c);
 
+#ifdef LFS_PROGV
+    // Optional vectored program, programs a list of regions in order. Each
+    // region has the same requirements as prog. Only used if prog_batch_count
+    // is non-zero. Negative error codes are propagated to the user.
+    // May return LFS_ERR_CORRUPT if the block should be considered bad.
+    int (*progv)(const struct lfs_config *c,
+            const struct lfs_segment *segments, lfs_size_t count);
+#endif
+
+#ifdef LFS_ASYNCERASE
+    // Optional asynchronous erase, starts erasing a block and returns without
+    // waiting for the erase to finish. littlefs calls complete before reading
+    // or programming the block. Only used if erase_depth is non-zero.
+    // Negative error codes are propagated to the user.
+    int (*erase_async)(const struct lfs_config *c, lfs_block_t block);
+
+    // Wait for the oldest outstanding asynchronous erase to finish. Stores the
+    // erased block in *block and returns the result of the erase. Required if
+    // erase_depth is non-zero. Negative error codes are propagated to the
+    // user. May return LFS_ERR_CORRUPT if the block should be considered bad.
+    int (*complete)(const struct lfs_config *c, lfs_block_t *block);
+#endif
+
+#ifdef LFS_TRIM
+    // Optional hint that a block no longer holds any data, letting FTLs and
+    // sparse files reclaim the space. The block's contents become undefined,
+    // it is always erased again before it is reused. Only used if
+    // trim_count is non-zero. Negative error codes are propagated to the
+    // user.
+    int (*trim)(const struct lfs_config *c, lfs_block_t block);
+#endif
+
 #ifdef LFS_THREADSAFE
     // Lock the underlying block device. Negative error codes
     // are propagated to the user.
@@ -223,12 +282,131 @@ struct lfs_config {
     // read and program sizes, and a factor of the block size.
     lfs_size_t cache_size;
 
+#ifdef LFS_READCACHE
+    // Optional number of additional read cache lines. Each line holds a
+    // cache_size portion of a block, and lines are replaced in
+    // least-recently-used order. Additional lines let littlefs keep recently
+    // read metadata and data cached when alternating between blocks, at the
+    // cost of read_cache_count*cache_size bytes of RAM, allocated with
+    // lfs_malloc. Defaults to 0, only using the single read cache.
+    lfs_size_t read_cache_count;
+#endif
+
+#ifdef LFS_PROGV
+    // Optional number of additional program cache buffers. When non-zero,
+    // the progs of a metadata commit are collected in these buffers and
+    // handed to progv in as few calls as possible, usually one per commit.
+    // This can reduce command overhead on block devices with expensive
+    // transactions, at the cost of prog_batch_count*cache_size bytes of RAM,
+    // allocated with lfs_malloc. Requires progv. Defaults to 0, issuing each
+    // prog immediately.
+    lfs_size_t prog_batch_count;
+#endif
+
+#ifdef LFS_ASYNCERASE
+    // Optional number of erases that may be in flight at once. When non-zero,
+    // erases are started with erase_async and littlefs keeps preparing the
+    // following progs while the block device erases, only waiting with
+    // complete when it needs the block. Failed erases count against
+    // erase_depth until they are reported, when none is left littlefs falls
+    // back to the synchronous erase. Defaults to 0, using the synchronous
+    // erase.
+    lfs_size_t erase_depth;
+#endif
+
+#ifdef LFS_PREERASE
+    // Optional number of free blocks to keep erased ahead of time. When
+    // non-zero, lfs_fs_gc and lfs_fs_gcstep erase up to preerase_count of
+    // the free blocks the allocator will hand out next, and writes to these
+    // blocks skip their erase. Pre-erased blocks are only tracked in RAM, so
+    // after a remount they are erased again like any other block. Allocated
+    // with lfs_malloc. Defaults to 0, erasing blocks when they are written.
+    lfs_size_t preerase_count;
+#endif
+
+#ifdef LFS_TRIM
+    // Optional number of freed blocks to remember for trim. When non-zero,
+    // blocks freed by removing, truncating, or rewriting files and
+    // directories are queued and passed to trim during lfs_fs_gc and
+    // lfs_fs_gcstep. If the queue fills up, the oldest blocks are left
+    // untrimmed. Requires trim. Allocated with lfs_malloc. Defaults to 0,
+    // never calling trim.
+    lfs_size_t trim_count;
+#endif
+
+#ifdef LFS_LOOKUPCACHE
+    // Optional number of path lookups to cache. When non-zero, each name
+    // found while resolving a path is remembered along with where it lives
+    // on disk, so resolving paths with the same leading directories does
+    // not need to fetch and search each directory again. Entries are
+    // dropped whenever their directory is committed to. Each entry costs
+    // name_max bytes of RAM plus a few words of state, allocated with
+    // lfs_malloc. Defaults to 0, searching each directory on every lookup.
+    lfs_size_t lookup_count;
+#endif
+
+#ifdef LFS_MDIRCACHE
+    // Optional number of fetched metadata pairs to cache. When non-zero,
+    // the state found by scanning a metadata pair's commit log is
+    // remembered, so fetching the same pair again, as traversals and path
+    // lookups often do, does not need to read and check the log again.
+    // Entries are dropped whenever their pair is committed to or one of its
+    // blocks is erased. Each entry costs a few words of RAM, allocated with
+    // lfs_malloc. Defaults to 0, scanning the log on every fetch.
+    lfs_size_t mdir_cache_count;
+#endif
+
+#ifdef LFS_BITMAP
+    // Optional size of a free-block bitmap in bytes, one bit per block. Must
+    // cover the whole filesystem, at least block_count/8 bytes. When
+    // non-zero, littlefs builds the bitmap with a single traversal and then
+    // keeps it up to date as blocks are allocated and as files are
+    // rewritten or removed, so allocation does not need to traverse the
+    // filesystem until the bitmap runs out of free blocks. Defaults to 0,
+    // using only the lookahead buffer.
+    lfs_size_t bitmap_size;
+#endif
+
     // Size of the lookahead buffer in bytes. A larger lookahead buffer
     // increases the number of blocks found during an allocation pass. The
     // lookahead buffer is stored as a compact bitmap, so each byte of RAM
     // can track 8 blocks.
     lfs_size_t lookahead_size;
 
+#ifdef LFS_SUMMARY
+    // Optional size of a free-space summary in bytes. When non-zero, every
+    // filesystem traversal that fills the lookahead buffer also records
+    // which blocks are in use across the whole disk, one bit per group of
+    // block_count/(8*summary_size) blocks, rounded up. Following lookahead
+    // windows are filled from this summary without traversing the
+    // filesystem, until the allocator wraps around the disk or reaches a
+    // group with both used and free blocks. Defaults to 0, traversing the
+    // filesystem for every lookahead window.
+    lfs_size_t summary_size;
+#endif
+
+#ifdef LFS_WEAR
+    // Optional size of a table of approximate erase counts in bytes, one
+    // byte per block. Must cover the whole filesystem, at least block_count
+    // bytes. When non-zero, littlefs counts erases per block and, when
+    // allocating, prefers the least worn free block it can choose without
+    // traversing the filesystem. When a count saturates, all counts are
+    // halved, so only their relative order is kept. Defaults to 0,
+    // allocating blocks in the order they are found.
+    lfs_size_t wear_size;
+#endif
+
+#ifdef LFS_EXTENTS
+    // Optional number of contiguous blocks to reserve for a file being
+    // written. When non-zero, each block appended to a file is allocated
+    // directly after the file's previous block when that block is free, and
+    // new extents start at the first run of extent_size free blocks the
+    // allocator knows about. Reserved blocks are unavailable to other
+    // allocations until the file uses them, moves elsewhere, or is closed.
+    // Defaults to 0, allocating blocks in the order they are found.
+    lfs_size_t extent_size;
+#endif
+
     // Threshold for metadata compaction during lfs_fs_gc in bytes. Metadata
     // pairs that exceed this threshold will be compacted during lfs_fs_gc.
     // Defaults to ~88% block_size when zero, though the default may change
@@ -252,6 +430,27 @@ struct lfs_config {
     // By default lfs_malloc is used to allocate this buffer.
     void *lookahead_buffer;
 
+#ifdef LFS_SUMMARY
+    // Optional statically allocated free-space summary. Must be
+    // summary_size. By default lfs_malloc is used to allocate this buffer.
+    void *summary_buffer;
+#endif
+
+#ifdef LFS_BITMAP
+    // Optional statically allocated free-block bitmap. Must be bitmap_size.
+    // By default lfs_malloc is used to allocate this buffer.
+    void *bitmap_buffer;
+#endif
+
+#ifdef LFS_WEAR
+    // Optional statically allocated erase-count table. Must be wear_size.
+    // Unlike other buffers, littlefs does not clear this buffer on mount, so
+    // erase counts can be persisted by saving this buffer after unmounting
+    // and restoring it before mounting. By default lfs_malloc is used to
+    // allocate this buffer, with all counts starting at zero.
+    void *wear_buffer;
+#endif
+
     // Optional upper limit on length of file names in bytes. No downside for
     // larger names except the size of the info struct which is controlled by
     // the LFS_NAME_MAX define. Defaults to LFS_NAME_MAX or name_max stored on
@@ -342,6 +541,31 @@ struct lfs_attr {
     lfs_size_t size;
 };
 
+// A buffer, used by vectored file operations
+struct lfs_iovec {
+    // Buffer to read into or write from
+    void *buffer;
+
+    // Size of the buffer in bytes
+    lfs_size_t size;
+};
+
+// An entry in a file's block index, see lfs_file_config.index_count
+struct lfs_index {
+    // Index of the block in the file's skip-list
+    lfs_off_t index;
+
+    // Address of the block
+    lfs_block_t block;
+};
+
+// A run of blocks a file allocates from, see lfs_config.extent_size
+struct lfs_extent {
+    lfs_block_t block;
+    lfs_block_t count;
+    bool reserved;
+};
+
 // Optional configuration provided during lfs_file_opencfg
 struct lfs_file_config {
     // Optional statically allocated file buffer. Must be cache_size.
@@ -363,6 +587,33 @@ struct lfs_file_config {
 
     // Number of custom attributes in the list
     lfs_size_t attr_count;
+
+#ifdef LFS_READAHEAD
+    // Optional size of the read-ahead window in bytes. When the file is read
+    // sequentially, littlefs reads up to this many bytes of the current block
+    // with a single block device read, reducing the number of reads needed to
+    // stream large files. Must be a multiple of the read size and a factor of
+    // the block size. Defaults to 0, disabling read-ahead.
+    lfs_size_t readahead_size;
+
+    // Optional statically allocated read-ahead buffer. Must be readahead_size.
+    // By default lfs_malloc is used to allocate this buffer.
+    void *readahead_buffer;
+#endif
+
+#ifdef LFS_FILEINDEX
+    // Optional number of entries in the file's block index. Seeking in a
+    // file requires walking its skip-list backwards from the last block,
+    // costing O(log n) reads. With an index, block addresses found during
+    // these walks are remembered, and later walks start from the nearest
+    // remembered block instead. Defaults to 0, disabling the index.
+    lfs_size_t index_count;
+
+    // Optional statically allocated block index. Must be index_count
+    // struct lfs_index entries. By default lfs_malloc is used to allocate
+    // this buffer.
+    struct lfs_index *index_buffer;
+#endif
 };
 
 
@@ -413,6 +664,15 @@ typedef struct lfs_file {
     lfs_block_t block;
     lfs_off_t off;
     lfs_cache_t cache;
+#ifdef LFS_READAHEAD
+    lfs_cache_t ahead;
+#endif
+#ifdef LFS_FILEINDEX
+    struct lfs_index *index;
+#endif
+#ifdef LFS_EXTENTS
+    struct lfs_extent extent;
+#endif
 
     const struct lfs_file_config *cfg;
 } lfs_file_t;
@@ -435,8 +695,53 @@ typedef struct lfs_gstate {
 typedef struct lfs {
     lfs_cache_t rcache;
     lfs_cache_t pcache;
+#ifdef LFS_READCACHE
+    lfs_cache_t *rlines;
+#endif
+#ifdef LFS_PROGV
+    struct lfs_segment *pbatch;
+    lfs_size_t pbatch_count;
+#endif
+#ifdef LFS_ASYNCERASE
+    struct lfs_inflight {
+        lfs_block_t *blocks;
+        lfs_size_t off;
+        lfs_size_t count;
+        lfs_size_t bad_count;
+    } inflight;
+#endif
+#ifdef LFS_PREERASE
+    struct lfs_preerase {
+        lfs_block_t *blocks;
+        lfs_size_t count;
+    } preerase;
+#endif
+#ifdef LFS_TRIM
+    struct lfs_trim {
+        lfs_block_t *blocks;
+        lfs_size_t count;
+    } trim;
+#endif
+#ifdef LFS_LOOKUPCACHE
+    struct lfs_lookup {
+        lfs_block_t parent[2];
+        lfs_block_t pair[2];
+        lfs_block_t child[2];
+        uint32_t tag;
+        uint32_t hash;
+        char *name;
+    } *lookups;
+    lfs_size_t lookup_next;
+#endif
+#ifdef LFS_MDIRCACHE
+    lfs_mdir_t *mdirs;
+    lfs_size_t mdir_next;
+#endif
 
     lfs_block_t root[2];
+#ifdef LFS_GCSTEP
+    lfs_block_t gctail[2];
+#endif
     struct lfs_mlist {
         struct lfs_mlist *next;
         uint16_t id;
@@ -457,6 +762,31 @@ typedef struct lfs {
         uint8_t *buffer;
     } lookahead;
 
+#ifdef LFS_SUMMARY
+    struct lfs_summary {
+        lfs_block_t group;
+        lfs_block_t remaining;
+        uint8_t *buffer;
+    } summary;
+#endif
+
+#ifdef LFS_BITMAP
+    struct lfs_bitmap {
+        lfs_block_t size;
+        lfs_block_t next;
+        lfs_block_t ckpoint;
+        lfs_block_t free;
+        uint8_t *buffer;
+    } bitmap;
+#endif
+
+#ifdef LFS_WEAR
+    uint8_t *wear;
+#endif
+#ifdef LFS_USEDCOUNT
+    lfs_block_t used;
+#endif
+
     const struct lfs_config *cfg;
     lfs_size_t block_count;
     lfs_size_t name_max;
@@ -606,6 +936,24 @@ int lfs_file_close(lfs_t *lfs, lfs_file_t *file);
 // Returns a negative error code on failure.
 int lfs_file_sync(lfs_t *lfs, lfs_file_t *file);
 
+#if !defined(LFS_READONLY) && defined(LFS_SYNCV)
+// Synchronize several files on storage at once
+//
+// Like lfs_file_sync, but the metadata of up to LFS_SYNCV_MAX files that
+// share a metadata pair, such as small files in the same directory, is
+// written with a single commit. Files written with the same commit are
+// updated atomically, after a power-loss either all or none of their changes
+// are visible. Large directories may be split over several metadata pairs,
+// which are committed one after another, as are any further files.
+//
+// Note this is not a general transaction, only the files' data and
+// attributes are committed together. Other operations, such as
+// lfs_setattr, lfs_mkdir, or lfs_rename, are always committed on their own.
+//
+// Returns a negative error code on failure.
+int lfs_file_syncv(lfs_t *lfs, lfs_file_t *const *files, lfs_size_t count);
+#endif
+
 // Read data from file
 //
 // Takes a buffer and size indicating where to store the read data.
@@ -624,6 +972,59 @@ lfs_ssize_t lfs_file_write(lfs_t *lfs, lfs_file_t *file,
         const void *buffer, lfs_size_t size);
 #endif
 
+#ifdef LFS_READV
+// Read data from file into several buffers
+//
+// Like lfs_file_read, but fills each buffer in iov in order, as if by a
+// single read of their combined size. Stops early at the end of the file.
+//
+// Returns the number of bytes read, or a negative error code on failure.
+lfs_ssize_t lfs_file_readv(lfs_t *lfs, lfs_file_t *file,
+        const struct lfs_iovec *iov, lfs_size_t count);
+
+#endif
+
+#if !defined(LFS_READONLY) && defined(LFS_READV)
+// Write data to file from several buffers
+//
+// Like lfs_file_write, but writes each buffer in iov in order, as if by a
+// single write of their combined size.
+//
+// Returns the number of bytes written, or a negative error code on failure.
+lfs_ssize_t lfs_file_writev(lfs_t *lfs, lfs_file_t *file,
+        const struct lfs_iovec *iov, lfs_size_t count);
+#endif
+
+#ifdef LFS_PREAD
+// Read data from file at a given offset
+//
+// Like lfs_file_read, but reads starting at off and leaves the file's
+// position unchanged. Any pending writes are flushed first. Reads in the
+// same block as the file's position skip looking up the block, and a
+// reading file's caches are kept, so nearby reads are cheap. Configuring a
+// file index_count makes looking up other blocks cheaper.
+//
+// Returns the number of bytes read, or a negative error code on failure.
+lfs_ssize_t lfs_file_pread(lfs_t *lfs, lfs_file_t *file,
+        void *buffer, lfs_size_t size, lfs_off_t off);
+
+#endif
+
+#if !defined(LFS_READONLY) && defined(LFS_PREAD)
+// Write data to file at a given offset
+//
+// Like lfs_file_write, but writes starting at off and leaves the file's
+// position unchanged. If the file was opened with LFS_O_APPEND, data is
+// still written to the end of the file.
+//
+// Note restoring the file's position requires flushing the write, so a
+// pwrite costs the same as a seek, write, and seek back.
+//
+// Returns the number of bytes written, or a negative error code on failure.
+lfs_ssize_t lfs_file_pwrite(lfs_t *lfs, lfs_file_t *file,
+        const void *buffer, lfs_size_t size, lfs_off_t off);
+#endif
+
 // Change the position of the file
 //
 // The change in position is determined by the offset and whence flag.
@@ -638,6 +1039,19 @@ lfs_soff_t lfs_file_seek(lfs_t *lfs, lfs_file_t *file,
 int lfs_file_truncate(lfs_t *lfs, lfs_file_t *file, lfs_off_t size);
 #endif
 
+#if !defined(LFS_READONLY) && defined(LFS_RESERVE)
+// Reserve blocks for a file to grow to the specified size
+//
+// Allocates and erases the blocks needed up front, so later writes up to
+// size don't need to allocate or erase. Blocks are reserved in a single
+// contiguous run where possible, fewer blocks may be reserved if free
+// space is fragmented or bad blocks are found. This does not change the
+// file's size, any unused blocks are released on close.
+//
+// Returns a negative error code on failure.
+int lfs_file_reserve(lfs_t *lfs, lfs_file_t *file, lfs_off_t size);
+#endif
+
 // Return the position of the file
 //
 // Equivalent to lfs_file_seek(lfs, file, 0, LFS_SEEK_CUR)
@@ -720,6 +1134,11 @@ int lfs_fs_stat(lfs_t *lfs, struct lfs_fsinfo *fsinfo);
 // Note: Result is best effort. If files share COW structures, the returned
 // size may be larger than the filesystem actually is.
 //
+// With LFS_USEDCOUNT, only the first call after mounting traverses the
+// filesystem, after that littlefs keeps a count of allocated blocks up to
+// date as files and directories are written and removed, so later calls
+// take constant time.
+//
 // Returns the number of allocated blocks, or a negative error code on failure.
 lfs_ssize_t lfs_fs_size(lfs_t *lfs);
 
@@ -751,6 +1170,8 @@ int lfs_fs_mkconsistent(lfs_t *lfs);
 // 1. Calls mkconsistent if not already consistent
 // 2. Compacts metadata > compact_thresh
 // 3. Populates the block allocator
+// 4. Erases free blocks ahead of time if preerase_count is non-zero
+// 5. Trims freed blocks if trim_count is non-zero
 //
 // Though additional janitorial work may be added in the future.
 //
@@ -762,6 +1183,22 @@ int lfs_fs_mkconsistent(lfs_t *lfs);
 int lfs_fs_gc(lfs_t *lfs);
 #endif
 
+#if !defined(LFS_READONLY) && defined(LFS_GCSTEP)
+// Attempt a bounded amount of janitorial work
+//
+// Does the same work as lfs_fs_gc, but stops after the given number of
+// steps, resuming where it left off on the next call. Each step fetches,
+// and if needed compacts, one metadata pair, or populates the block
+// allocator, which requires a filesystem traversal, and tops up any
+// pre-erased blocks and trims any freed blocks. Changes to the
+// filesystem between calls are fine, though new metadata pairs may not be
+// visited until the next pass.
+//
+// Returns a positive value if there is more work to do, 0 once a full pass
+// has completed, or a negative error code on failure.
+int lfs_fs_gcstep(lfs_t *lfs, lfs_size_t steps);
+#endif
+
 #ifndef LFS_READONLY
 // Grows the filesystem to a new size, updating the superblock with the new
 // block count.
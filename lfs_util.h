@@ -212,9 +212,20 @@ static inline uint32_t lfs_tobe32(uint32_t a) {
 }
 
 // Calculate CRC-32 with polynomial = 0x04c11db7
+//
+// LFS_CRC_HW plugs lfs_crc_hw into LFS_CRC, which uses carry-less
+// multiplication on x86-64 or the CRC32 instructions on AArch64 when the
+// CPU supports them, falling back to the software implementation otherwise
+#ifdef LFS_CRC_HW
+uint32_t lfs_crc_hw(uint32_t crc, const void *buffer, size_t size);
+#ifndef LFS_CRC
+#define LFS_CRC lfs_crc_hw
+#endif
+#endif
+
 #ifdef LFS_CRC
-uint32_t lfs_crc(uint32_t crc, const void *buffer, size_t size) {
-    return LFS_CRC(crc, buffer, size)
+static inline uint32_t lfs_crc(uint32_t crc, const void *buffer, size_t size) {
+    return LFS_CRC(crc, buffer, size);
 }
 #else
 uint32_t lfs_crc(uint32_t crc, const void *buffer, size_t size);
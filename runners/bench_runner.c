@@ -1314,13 +1314,28 @@ void perm_run(
         .prog               = lfs_emubd_prog,
         .erase              = lfs_emubd_erase,
         .sync               = lfs_emubd_sync,
+        .progv              = lfs_emubd_progv,
+        .erase_async        = lfs_emubd_erase_async,
+        .complete           = lfs_emubd_complete,
+        .trim               = lfs_emubd_trim,
         .read_size          = READ_SIZE,
         .prog_size          = PROG_SIZE,
         .block_size         = BLOCK_SIZE,
         .block_count        = BLOCK_COUNT,
         .block_cycles       = BLOCK_CYCLES,
         .cache_size         = CACHE_SIZE,
+        .read_cache_count   = READ_CACHE_COUNT,
+        .prog_batch_count   = PROG_BATCH_COUNT,
+        .erase_depth        = ERASE_DEPTH,
+        .preerase_count     = PREERASE_COUNT,
+        .trim_count         = TRIM_COUNT,
+        .lookup_count       = LOOKUP_COUNT,
+        .mdir_cache_count   = MDIR_CACHE_COUNT,
+        .bitmap_size        = BITMAP_SIZE,
         .lookahead_size     = LOOKAHEAD_SIZE,
+        .summary_size       = SUMMARY_SIZE,
+        .extent_size        = EXTENT_SIZE,
+        .wear_size          = WEAR_SIZE,
         .compact_thresh     = COMPACT_THRESH,
         .inline_max         = INLINE_MAX,
     };
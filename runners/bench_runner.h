@@ -97,11 +97,22 @@ intmax_t bench_define(size_t define);
 #define LOOKAHEAD_SIZE_i     7
 #define COMPACT_THRESH_i     8
 #define INLINE_MAX_i         9
-#define BLOCK_CYCLES_i       10
-#define ERASE_VALUE_i        11
-#define ERASE_CYCLES_i       12
-#define BADBLOCK_BEHAVIOR_i  13
-#define POWERLOSS_BEHAVIOR_i 14
+#define READ_CACHE_COUNT_i   10
+#define PROG_BATCH_COUNT_i   11
+#define ERASE_DEPTH_i        12
+#define PREERASE_COUNT_i     13
+#define TRIM_COUNT_i         14
+#define LOOKUP_COUNT_i       15
+#define MDIR_CACHE_COUNT_i   16
+#define BITMAP_SIZE_i        17
+#define SUMMARY_SIZE_i       18
+#define EXTENT_SIZE_i        19
+#define WEAR_SIZE_i          20
+#define BLOCK_CYCLES_i       21
+#define ERASE_VALUE_i        22
+#define ERASE_CYCLES_i       23
+#define BADBLOCK_BEHAVIOR_i  24
+#define POWERLOSS_BEHAVIOR_i 25
 
 #define READ_SIZE           bench_define(READ_SIZE_i)
 #define PROG_SIZE           bench_define(PROG_SIZE_i)
@@ -113,6 +124,17 @@ intmax_t bench_define(size_t define);
 #define LOOKAHEAD_SIZE      bench_define(LOOKAHEAD_SIZE_i)
 #define COMPACT_THRESH      bench_define(COMPACT_THRESH_i)
 #define INLINE_MAX          bench_define(INLINE_MAX_i)
+#define READ_CACHE_COUNT    bench_define(READ_CACHE_COUNT_i)
+#define PROG_BATCH_COUNT    bench_define(PROG_BATCH_COUNT_i)
+#define ERASE_DEPTH         bench_define(ERASE_DEPTH_i)
+#define PREERASE_COUNT      bench_define(PREERASE_COUNT_i)
+#define TRIM_COUNT          bench_define(TRIM_COUNT_i)
+#define LOOKUP_COUNT        bench_define(LOOKUP_COUNT_i)
+#define MDIR_CACHE_COUNT    bench_define(MDIR_CACHE_COUNT_i)
+#define BITMAP_SIZE         bench_define(BITMAP_SIZE_i)
+#define SUMMARY_SIZE        bench_define(SUMMARY_SIZE_i)
+#define EXTENT_SIZE         bench_define(EXTENT_SIZE_i)
+#define WEAR_SIZE           bench_define(WEAR_SIZE_i)
 #define BLOCK_CYCLES        bench_define(BLOCK_CYCLES_i)
 #define ERASE_VALUE         bench_define(ERASE_VALUE_i)
 #define ERASE_CYCLES        bench_define(ERASE_CYCLES_i)
@@ -130,6 +152,17 @@ intmax_t bench_define(size_t define);
     BENCH_DEF(LOOKAHEAD_SIZE,     16) \
     BENCH_DEF(COMPACT_THRESH,     0) \
     BENCH_DEF(INLINE_MAX,         0) \
+    BENCH_DEF(READ_CACHE_COUNT,   0) \
+    BENCH_DEF(PROG_BATCH_COUNT,   0) \
+    BENCH_DEF(ERASE_DEPTH,        0) \
+    BENCH_DEF(PREERASE_COUNT,     0) \
+    BENCH_DEF(TRIM_COUNT,         0) \
+    BENCH_DEF(LOOKUP_COUNT,       0) \
+    BENCH_DEF(MDIR_CACHE_COUNT,   0) \
+    BENCH_DEF(BITMAP_SIZE,        0) \
+    BENCH_DEF(SUMMARY_SIZE,       0) \
+    BENCH_DEF(EXTENT_SIZE,        0) \
+    BENCH_DEF(WEAR_SIZE,          0) \
     BENCH_DEF(BLOCK_CYCLES,       -1) \
     BENCH_DEF(ERASE_VALUE,        0xff) \
     BENCH_DEF(ERASE_CYCLES,       0) \
@@ -137,7 +170,7 @@ intmax_t bench_define(size_t define);
     BENCH_DEF(POWERLOSS_BEHAVIOR, LFS_EMUBD_POWERLOSS_NOOP)
 
 #define BENCH_GEOMETRY_DEFINE_COUNT 4
-#define BENCH_IMPLICIT_DEFINE_COUNT 15
+#define BENCH_IMPLICIT_DEFINE_COUNT 26
 
 
 #endif
@@ -90,12 +90,23 @@ intmax_t test_define(size_t define);
 #define LOOKAHEAD_SIZE_i     7
 #define COMPACT_THRESH_i     8
 #define INLINE_MAX_i         9
-#define BLOCK_CYCLES_i       10
-#define ERASE_VALUE_i        11
-#define ERASE_CYCLES_i       12
-#define BADBLOCK_BEHAVIOR_i  13
-#define POWERLOSS_BEHAVIOR_i 14
-#define DISK_VERSION_i       15
+#define READ_CACHE_COUNT_i   10
+#define PROG_BATCH_COUNT_i   11
+#define ERASE_DEPTH_i        12
+#define PREERASE_COUNT_i     13
+#define TRIM_COUNT_i         14
+#define LOOKUP_COUNT_i       15
+#define MDIR_CACHE_COUNT_i   16
+#define BITMAP_SIZE_i        17
+#define SUMMARY_SIZE_i       18
+#define EXTENT_SIZE_i        19
+#define WEAR_SIZE_i          20
+#define BLOCK_CYCLES_i       21
+#define ERASE_VALUE_i        22
+#define ERASE_CYCLES_i       23
+#define BADBLOCK_BEHAVIOR_i  24
+#define POWERLOSS_BEHAVIOR_i 25
+#define DISK_VERSION_i       26
 
 #define READ_SIZE           TEST_DEFINE(READ_SIZE_i)
 #define PROG_SIZE           TEST_DEFINE(PROG_SIZE_i)
@@ -107,6 +118,17 @@ intmax_t test_define(size_t define);
 #define LOOKAHEAD_SIZE      TEST_DEFINE(LOOKAHEAD_SIZE_i)
 #define COMPACT_THRESH      TEST_DEFINE(COMPACT_THRESH_i)
 #define INLINE_MAX          TEST_DEFINE(INLINE_MAX_i)
+#define READ_CACHE_COUNT    TEST_DEFINE(READ_CACHE_COUNT_i)
+#define PROG_BATCH_COUNT    TEST_DEFINE(PROG_BATCH_COUNT_i)
+#define ERASE_DEPTH         TEST_DEFINE(ERASE_DEPTH_i)
+#define PREERASE_COUNT      TEST_DEFINE(PREERASE_COUNT_i)
+#define TRIM_COUNT          TEST_DEFINE(TRIM_COUNT_i)
+#define LOOKUP_COUNT        TEST_DEFINE(LOOKUP_COUNT_i)
+#define MDIR_CACHE_COUNT    TEST_DEFINE(MDIR_CACHE_COUNT_i)
+#define BITMAP_SIZE         TEST_DEFINE(BITMAP_SIZE_i)
+#define SUMMARY_SIZE        TEST_DEFINE(SUMMARY_SIZE_i)
+#define EXTENT_SIZE         TEST_DEFINE(EXTENT_SIZE_i)
+#define WEAR_SIZE           TEST_DEFINE(WEAR_SIZE_i)
 #define BLOCK_CYCLES        TEST_DEFINE(BLOCK_CYCLES_i)
 #define ERASE_VALUE         TEST_DEFINE(ERASE_VALUE_i)
 #define ERASE_CYCLES        TEST_DEFINE(ERASE_CYCLES_i)
@@ -125,6 +147,17 @@ intmax_t test_define(size_t define);
     TEST_DEF(LOOKAHEAD_SIZE,     16) \
     TEST_DEF(COMPACT_THRESH,     0) \
     TEST_DEF(INLINE_MAX,         0) \
+    TEST_DEF(READ_CACHE_COUNT,   0) \
+    TEST_DEF(PROG_BATCH_COUNT,   0) \
+    TEST_DEF(ERASE_DEPTH,        0) \
+    TEST_DEF(PREERASE_COUNT,     0) \
+    TEST_DEF(TRIM_COUNT,         0) \
+    TEST_DEF(LOOKUP_COUNT,       0) \
+    TEST_DEF(MDIR_CACHE_COUNT,   0) \
+    TEST_DEF(BITMAP_SIZE,        0) \
+    TEST_DEF(SUMMARY_SIZE,       0) \
+    TEST_DEF(EXTENT_SIZE,        0) \
+    TEST_DEF(WEAR_SIZE,          0) \
     TEST_DEF(BLOCK_CYCLES,       -1) \
     TEST_DEF(ERASE_VALUE,        0xff) \
     TEST_DEF(ERASE_CYCLES,       0) \
@@ -133,7 +166,7 @@ intmax_t test_define(size_t define);
     TEST_DEF(DISK_VERSION,       0)
 
 #define TEST_GEOMETRY_DEFINE_COUNT 4
-#define TEST_IMPLICIT_DEFINE_COUNT 16
+#define TEST_IMPLICIT_DEFINE_COUNT 27
 
 
 #endif